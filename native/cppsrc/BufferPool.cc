@@ -0,0 +1,42 @@
+#include "BufferPool.h"
+#include <stdlib.h>
+
+BufferPool::~BufferPool()
+{
+    for (char* buffer : mFree) {
+        ::free(buffer);
+    }
+}
+
+char* BufferPool::acquire()
+{
+    {
+        MutexLocker locker(&mMutex);
+        if (!mFree.empty()) {
+            char* buffer = mFree.back();
+            mFree.pop_back();
+            mHits.fetch_add(1, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<char*>(malloc(BufferSize));
+}
+
+void BufferPool::release(char* buffer)
+{
+    {
+        MutexLocker locker(&mMutex);
+        if (mFree.size() < MaxFree) {
+            mFree.push_back(buffer);
+            return;
+        }
+    }
+    ::free(buffer);
+}
+
+size_t BufferPool::free()
+{
+    MutexLocker locker(&mMutex);
+    return mFree.size();
+}
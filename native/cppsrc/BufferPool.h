@@ -0,0 +1,34 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "utils.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// fixed size read buffers, handed out on the reader thread and given back
+// from the js thread once the Buffer wrapping them has been collected
+class BufferPool
+{
+public:
+    enum { BufferSize = 16384, MaxFree = 256 };
+
+    BufferPool() = default;
+    ~BufferPool();
+
+    // always returns a buffer of BufferSize bytes
+    char* acquire();
+    void release(char* buffer);
+
+    uint64_t hits() const { return mHits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return mMisses.load(std::memory_order_relaxed); }
+    size_t free();
+
+private:
+    Mutex mMutex;
+    std::vector<char*> mFree;
+    std::atomic<uint64_t> mHits { 0 }, mMisses { 0 };
+};
+
+#endif
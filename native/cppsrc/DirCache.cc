@@ -0,0 +1,119 @@
+#include "DirCache.h"
+#include <algorithm>
+#include <unistd.h>
+
+static int64_t mtimeOf(const struct stat& st)
+{
+#ifdef __APPLE__
+    return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+std::shared_ptr<DirCache::Listing> DirCache::lookup(const std::string& dir, const struct stat& st)
+{
+    MutexLocker locker(&mMutex);
+    auto it = mListings.find(dir);
+    if (it == mListings.end())
+        return nullptr;
+    const auto& listing = it->second.first;
+    if (listing->dev != st.st_dev || listing->ino != st.st_ino || listing->mtime != mtimeOf(st))
+        return nullptr;
+    mLRU.splice(mLRU.begin(), mLRU, it->second.second);
+    return listing;
+}
+
+void DirCache::insert(const std::string& dir, const std::shared_ptr<Listing>& listing)
+{
+    MutexLocker locker(&mMutex);
+    auto it = mListings.find(dir);
+    if (it != mListings.end()) {
+        mEntries -= it->second.first->entries.size();
+        mLRU.erase(it->second.second);
+        mListings.erase(it);
+    }
+    mLRU.push_front(dir);
+    mListings[dir] = std::make_pair(listing, mLRU.begin());
+    mEntries += listing->entries.size();
+
+    // never evict what we just added
+    while (mListings.size() > 1 && (mListings.size() > MaxDirs || mEntries > MaxEntries)) {
+        auto victim = mListings.find(mLRU.back());
+        mEntries -= victim->second.first->entries.size();
+        mListings.erase(victim);
+        mLRU.pop_back();
+        mEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int DirCache::query(const std::string& dir, const std::string& prefix, DirScanner::Filter filter, std::vector<std::string>& out)
+{
+    struct stat st;
+    if (::stat(dir.empty() ? "." : dir.c_str(), &st) != 0)
+        return errno;
+
+    auto listing = lookup(dir, st);
+    if (listing) {
+        mHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        listing = std::make_shared<Listing>();
+        listing->dev = st.st_dev;
+        listing->ino = st.st_ino;
+        listing->mtime = mtimeOf(st);
+        const int err = DirScanner::read(dir, listing->entries);
+        if (err != 0)
+            return err;
+        insert(dir, listing);
+    }
+
+    MutexLocker locker(&listing->mutex);
+    auto& entries = listing->entries;
+
+    auto begin = entries.begin(), end = entries.end();
+    if (!listing->lastPrefix.empty() && prefix.size() >= listing->lastPrefix.size()
+        && DirScanner::startsWithNoCase(prefix.c_str(), listing->lastPrefix)) {
+        begin = entries.begin() + listing->lastBegin;
+        end = entries.begin() + listing->lastEnd;
+        mNarrowed.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto it = std::lower_bound(begin, end, prefix, [](const DirScanner::Entry& entry, const std::string& p) {
+        return DirScanner::lessFolded(entry.name, p);
+    });
+    const size_t first = it - entries.begin();
+
+    const uint8_t needed = filter == DirScanner::FilterExecutableOrDirectory
+        ? DirScanner::Entry::Resolved | DirScanner::Entry::ExecResolved
+        : DirScanner::Entry::Resolved;
+    int dirfd = -1;
+    for (; it != end && DirScanner::startsWithNoCase(it->name.c_str(), prefix); ++it) {
+        DirScanner::resolve(dir, dirfd, *it, needed);
+        const bool directory = it->flags & DirScanner::Entry::Directory;
+        if (filter == DirScanner::FilterExecutableOrDirectory && !directory && !(it->flags & DirScanner::Entry::Executable))
+            continue;
+        out.push_back(directory ? it->name + "/" : it->name);
+    }
+    if (dirfd != -1) {
+        int e;
+        EINTRWRAP(e, ::close(dirfd));
+    }
+
+    listing->lastPrefix = prefix;
+    listing->lastBegin = first;
+    listing->lastEnd = it - entries.begin();
+    return 0;
+}
+
+DirCache::Stats DirCache::stats()
+{
+    MutexLocker locker(&mMutex);
+    return {
+        mHits.load(std::memory_order_relaxed),
+        mMisses.load(std::memory_order_relaxed),
+        mEvictions.load(std::memory_order_relaxed),
+        mNarrowed.load(std::memory_order_relaxed),
+        mListings.size(),
+        mEntries
+    };
+}
@@ -0,0 +1,64 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include "DirScanner.h"
+#include "utils.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// least recently used directory listings for completion. A listing is
+// valid for as long as the directory's dev, inode and mtime stay the
+// same, so repeated completions in the same directory don't touch the
+// filesystem beyond one stat. Thread safe
+class DirCache
+{
+public:
+    enum { MaxDirs = 64, MaxEntries = 1024 * 1024 };
+
+    DirCache() = default;
+
+    // entries in dir starting with prefix, see DirScanner::read() for the
+    // ordering. directories get a trailing slash. returns an errno value
+    int query(const std::string& dir, const std::string& prefix, DirScanner::Filter filter, std::vector<std::string>& out);
+
+    struct Stats
+    {
+        uint64_t hits, misses, evictions, narrowed;
+        size_t dirs, entries;
+    };
+    Stats stats();
+
+private:
+    struct Listing
+    {
+        dev_t dev;
+        ino_t ino;
+        int64_t mtime;
+
+        // protects entries and the narrowing state below
+        Mutex mutex;
+        std::vector<DirScanner::Entry> entries;
+        // range of the last prefix so that typing more of it
+        // only has to look at what matched last time
+        std::string lastPrefix;
+        size_t lastBegin { 0 }, lastEnd { 0 };
+    };
+
+    std::shared_ptr<Listing> lookup(const std::string& dir, const struct stat& st);
+    void insert(const std::string& dir, const std::shared_ptr<Listing>& listing);
+
+    Mutex mMutex;
+    typedef std::list<std::string> LRU;
+    LRU mLRU;
+    std::unordered_map<std::string, std::pair<std::shared_ptr<Listing>, LRU::iterator> > mListings;
+    size_t mEntries { 0 };
+
+    std::atomic<uint64_t> mHits { 0 }, mMisses { 0 }, mEvictions { 0 }, mNarrowed { 0 };
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "DirScanner.h"
+#include "utils.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace DirScanner {
+
+Permissions::Permissions()
+{
+    uid = getuid();
+    const int num = getgroups(0, nullptr);
+    if (num > 0) {
+        gids.resize(num);
+        if (getgroups(num, &gids[0]) != num)
+            gids.clear();
+    }
+    gids.push_back(getgid());
+}
+
+bool Permissions::isExecutable(const struct stat& st) const
+{
+    if (!S_ISREG(st.st_mode))
+        return false;
+    if (st.st_uid == uid && (st.st_mode & 0500) == 0500)
+        return true;
+    if ((st.st_mode & 0050) == 0050 && std::find(gids.begin(), gids.end(), st.st_gid) != gids.end())
+        return true;
+    return (st.st_mode & 0005) == 0005;
+}
+
+Type fromDType(unsigned char type)
+{
+    switch (type) {
+    case DT_REG:
+        return TypeFile;
+    case DT_DIR:
+        return TypeDirectory;
+    case DT_LNK:
+        return TypeSymlink;
+    case DT_UNKNOWN:
+        return TypeUnknown;
+    default:
+        return TypeOther;
+    }
+}
+
+static inline char fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+bool startsWithNoCase(const char* str, const std::string& prefix)
+{
+    for (char c : prefix) {
+        if (*str == '\0' || fold(*str) != fold(c))
+            return false;
+        ++str;
+    }
+    return true;
+}
+
+bool lessNoCase(const std::string& a, const std::string& b)
+{
+    const size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char ca = fold(a[i]), cb = fold(b[i]);
+        if (ca != cb)
+            return ca < cb;
+    }
+    if (a.size() != b.size())
+        return a.size() < b.size();
+    // keep the order stable for names that only differ in case
+    return a < b;
+}
+
+bool lessFolded(const std::string& a, const std::string& b)
+{
+    const size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char ca = fold(a[i]), cb = fold(b[i]);
+        if (ca != cb)
+            return ca < cb;
+    }
+    return a.size() < b.size();
+}
+
+int read(const std::string& dir, std::vector<Entry>& entries)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1)
+        return errno;
+
+    const bool ok = forEachEntry(fd, [&entries](const char* name, Type type) {
+        switch (type) {
+        case TypeFile:
+        case TypeOther:
+            entries.push_back({ name, Entry::Resolved });
+            break;
+        case TypeDirectory:
+            entries.push_back({ name, Entry::Resolved | Entry::Directory });
+            break;
+        default:
+            entries.push_back({ name, 0 });
+            break;
+        }
+    });
+    const int err = ok ? 0 : errno;
+
+    int e;
+    EINTRWRAP(e, ::close(fd));
+    if (!ok)
+        return err;
+
+    entries.push_back({ ".", Entry::Resolved | Entry::Directory });
+    entries.push_back({ "..", Entry::Resolved | Entry::Directory });
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return lessNoCase(a.name, b.name);
+    });
+    return 0;
+}
+
+void resolve(const std::string& dir, int& dirfd, Entry& entry, uint8_t flags)
+{
+    static const Permissions permissions;
+
+    if ((entry.flags & flags) == flags)
+        return;
+    // directories are never executable files
+    if ((entry.flags & (Entry::Resolved | Entry::Directory)) == (Entry::Resolved | Entry::Directory)) {
+        entry.flags |= Entry::ExecResolved;
+        return;
+    }
+
+    if (dirfd == -1) {
+        EINTRWRAP(dirfd, ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    }
+    struct stat st;
+    if (dirfd == -1 || fstatat(dirfd, entry.name.c_str(), &st, 0) != 0) {
+        // dangling symlink or gone in the meantime, treat it as a plain file
+        entry.flags |= Entry::Resolved | Entry::ExecResolved;
+        return;
+    }
+    entry.flags |= Entry::Resolved | Entry::ExecResolved;
+    if (S_ISDIR(st.st_mode)) {
+        entry.flags |= Entry::Directory;
+    } else if (permissions.isExecutable(st)) {
+        entry.flags |= Entry::Executable;
+    }
+}
+
+} // namespace DirScanner
@@ -0,0 +1,128 @@
+#ifndef DIRSCANNER_H
+#define DIRSCANNER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+namespace DirScanner {
+
+// the current user's view of file permissions,
+// same rules as isExecutable() in utils.ts
+struct Permissions
+{
+    Permissions();
+
+    bool isExecutable(const struct stat& st) const;
+
+    uid_t uid;
+    std::vector<gid_t> gids;
+};
+
+enum Type { TypeUnknown, TypeFile, TypeDirectory, TypeSymlink, TypeOther };
+
+// calls func(const char* name, Type type) for every entry in the
+// directory fd refers to, except for . and .. The type comes from the
+// directory entry itself so most entries don't need a stat
+template<typename Func>
+bool forEachEntry(int fd, Func&& func);
+
+enum Filter { FilterNone, FilterExecutableOrDirectory };
+
+struct Entry
+{
+    enum {
+        // set once we know whether this is a directory
+        Resolved = 0x1,
+        Directory = 0x2,
+        // set once we know whether this is executable
+        ExecResolved = 0x4,
+        Executable = 0x8
+    };
+    std::string name;
+    uint8_t flags;
+};
+
+// every entry in dir, . and .. included like readdir(3) would, sorted
+// by lessNoCase. only the entry types from the directory itself are used,
+// symlinks and the like are left for resolve(). returns an errno value
+int read(const std::string& dir, std::vector<Entry>& entries);
+
+// fills in the flags asked for, dirfd is opened on demand
+void resolve(const std::string& dir, int& dirfd, Entry& entry, uint8_t flags);
+
+bool startsWithNoCase(const char* str, const std::string& prefix);
+// case insensitive order, names that only differ in case are ordered by byte
+bool lessNoCase(const std::string& a, const std::string& b);
+// case insensitive order only, every name starting with a prefix
+// sorts at or after it
+bool lessFolded(const std::string& a, const std::string& b);
+
+Type fromDType(unsigned char type);
+
+} // namespace DirScanner
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+template<typename Func>
+bool DirScanner::forEachEntry(int fd, Func&& func)
+{
+    auto dispatch = [&func](const char* name, unsigned char type) {
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            return;
+        func(name, fromDType(type));
+    };
+#ifdef __linux__
+    struct linux_dirent64
+    {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+    alignas(linux_dirent64) char buf[32768];
+    for (;;) {
+        long r;
+        do {
+            r = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        } while (r == -1 && errno == EINTR);
+        if (r == 0)
+            return true;
+        if (r < 0)
+            return false;
+        for (long off = 0; off < r; ) {
+            const linux_dirent64* ent = reinterpret_cast<const linux_dirent64*>(buf + off);
+            dispatch(ent->d_name, ent->d_type);
+            off += ent->d_reclen;
+        }
+    }
+#else
+    // readdir takes ownership of the fd, give it its own
+    const int dfd = dup(fd);
+    if (dfd == -1)
+        return false;
+    DIR* d = fdopendir(dfd);
+    if (!d) {
+        ::close(dfd);
+        return false;
+    }
+    while (dirent* ent = readdir(d)) {
+        dispatch(ent->d_name, ent->d_type);
+    }
+    closedir(d);
+    return true;
+#endif
+}
+
+#endif
@@ -0,0 +1,657 @@
+#include "GitCache.h"
+#include "DirScanner.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#ifdef __linux__
+
+enum { MaxLookups = 1024 };
+
+static uint64_t now()
+{
+    return uv_hrtime() / 1000000;
+}
+
+static bool startsWith(const std::string& str, const std::string& prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+static std::string directoryOf(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+struct GitCache::Repo
+{
+    GitRepo repo;
+    std::unique_ptr<GitIndex> index;
+    // check() for each index entry
+    std::vector<uint32_t> results;
+    // GitRepo::converts() for the index
+    bool converts { false };
+    std::set<std::string> untracked;
+    // the walked worktree directories and their ignores
+    std::unordered_map<std::string, std::shared_ptr<const GitIgnoreStack> > directories;
+    // ignored directories with tracked files in them, watched for those
+    std::set<std::string> ignoredDirectories;
+    GitRepo::Refs refs;
+    std::string head;
+    // a watch couldn't be added, most likely out of inotify watches
+    bool failed { false };
+
+    // what the pending events call for
+    bool rescan { true }, reindex { false }, reread { false }, gone { false };
+    std::set<std::string> paths, newDirs, goneDirs;
+    uint64_t firstEvent { 0 }, lastEvent { 0 };
+
+    bool pending() const
+    {
+        return rescan || reindex || reread || gone || !paths.empty() || !newDirs.empty() || !goneDirs.empty();
+    }
+    void clearPending()
+    {
+        rescan = reindex = reread = false;
+        paths.clear();
+        newDirs.clear();
+        goneDirs.clear();
+    }
+};
+
+GitCache::GitCache()
+{
+}
+
+GitCache::~GitCache()
+{
+    stop();
+}
+
+std::shared_ptr<const GitCache::Snapshot> GitCache::snapshot(const std::string& path, std::string& prefix)
+{
+    std::string key = path;
+    if (key.empty() || key[0] != '/') {
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, sizeof(cwd)))
+            return nullptr;
+        key = std::string(cwd) + "/" + path;
+    }
+
+    MutexLocker locker(&mMutex);
+    if (mStopped)
+        return nullptr;
+
+    auto lookup = mLookups.find(key);
+    if (lookup == mLookups.end()) {
+        locker.unlock();
+        GitRepo repo;
+        if (!repo.open(key))
+            return nullptr;
+        locker.relock();
+        if (mLookups.size() >= MaxLookups)
+            mLookups.clear();
+        lookup = mLookups.emplace(key, std::make_pair(repo.worktree(), repo.prefix())).first;
+    }
+    const std::string worktree = lookup->second.first;
+    prefix = lookup->second.second;
+
+    if (mFailed.count(worktree))
+        return nullptr;
+    mUsed[worktree] = ++mUseCounter;
+    auto it = mSnapshots.find(worktree);
+    if (it != mSnapshots.end())
+        return it->second;
+
+    // being scanned, or not a repository anymore. look it up again next time
+    mLookups.erase(lookup);
+    if (std::find(mRequests.begin(), mRequests.end(), worktree) == mRequests.end())
+        mRequests.push_back(worktree);
+    if (!mStarted) {
+        mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (mInotify == -1 || pipe2(mWakeup, O_NONBLOCK | O_CLOEXEC) == -1) {
+            if (mInotify != -1) {
+                int e;
+                EINTRWRAP(e, ::close(mInotify));
+                mInotify = -1;
+            }
+            mStopped = true;
+            return nullptr;
+        }
+        mStarted = true;
+        uv_thread_create(&mThread, run, this);
+    }
+    wakeup();
+    return nullptr;
+}
+
+void GitCache::wakeup()
+{
+    const char c = 'w';
+    ssize_t w;
+    EINTRWRAP(w, ::write(mWakeup[1], &c, 1));
+}
+
+void GitCache::stop()
+{
+    {
+        MutexLocker locker(&mMutex);
+        if (mStopped || !mStarted) {
+            mStopped = true;
+            return;
+        }
+        mStopped = true;
+        wakeup();
+    }
+    uv_thread_join(&mThread);
+
+    int e;
+    EINTRWRAP(e, ::close(mInotify));
+    EINTRWRAP(e, ::close(mWakeup[0]));
+    EINTRWRAP(e, ::close(mWakeup[1]));
+    mInotify = mWakeup[0] = mWakeup[1] = -1;
+    mWatches.clear();
+    mRepos.clear();
+}
+
+void GitCache::run(void* arg)
+{
+    static_cast<GitCache*>(arg)->process();
+}
+
+void GitCache::process()
+{
+    for (;;) {
+        int timeout = -1;
+        const uint64_t current = now();
+        for (const auto& repo : mRepos) {
+            if (!repo->pending())
+                continue;
+            const uint64_t due = std::min(repo->lastEvent + SettleTime, repo->firstEvent + MaxDelay);
+            const int wait = due > current ? static_cast<int>(due - current) : 0;
+            if (timeout == -1 || wait < timeout)
+                timeout = wait;
+        }
+
+        pollfd fds[2] = { { mInotify, POLLIN, 0 }, { mWakeup[0], POLLIN, 0 } };
+        int r;
+        EINTRWRAP(r, ::poll(fds, 2, timeout));
+
+        if (fds[1].revents & POLLIN) {
+            char buf[64];
+            ssize_t rd;
+            do {
+                EINTRWRAP(rd, ::read(mWakeup[0], buf, sizeof(buf)));
+            } while (rd > 0);
+        }
+
+        std::vector<std::string> requests;
+        {
+            MutexLocker locker(&mMutex);
+            if (mStopped)
+                return;
+            std::swap(requests, mRequests);
+        }
+
+        for (const auto& worktree : requests) {
+            if (std::find_if(mRepos.begin(), mRepos.end(), [&worktree](const std::unique_ptr<Repo>& repo) {
+                    return repo->repo.worktree() == worktree;
+                }) != mRepos.end()) {
+                continue;
+            }
+            auto repo = std::make_unique<Repo>();
+            if (!repo->repo.open(worktree) || repo->repo.worktree() != worktree)
+                continue;
+            if (mRepos.size() >= MaxRepos) {
+                // the one asked about the longest ago goes
+                size_t victim = 0;
+                {
+                    MutexLocker locker(&mMutex);
+                    for (size_t i = 1; i < mRepos.size(); ++i) {
+                        if (mUsed[mRepos[i]->repo.worktree()] < mUsed[mRepos[victim]->repo.worktree()])
+                            victim = i;
+                    }
+                }
+                remove(*mRepos[victim]);
+                mRepos.erase(mRepos.begin() + victim);
+            }
+            mRepos.push_back(std::move(repo));
+            if (!scan(*mRepos.back())) {
+                remove(*mRepos.back());
+                mRepos.pop_back();
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+            drainEvents();
+
+        const uint64_t updated = now();
+        for (size_t i = 0; i < mRepos.size(); ) {
+            Repo& repo = *mRepos[i];
+            if (repo.pending() && (updated - repo.lastEvent >= SettleTime || updated - repo.firstEvent >= MaxDelay)) {
+                if (repo.gone || !update(repo)) {
+                    remove(repo);
+                    mRepos.erase(mRepos.begin() + i);
+                    continue;
+                }
+            }
+            ++i;
+        }
+    }
+}
+
+void GitCache::drainEvents()
+{
+    alignas(inotify_event) char buf[16384];
+    for (;;) {
+        ssize_t r;
+        EINTRWRAP(r, ::read(mInotify, buf, sizeof(buf)));
+        if (r <= 0)
+            break;
+        for (char* ptr = buf; ptr < buf + r; ) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + ev->len;
+            // lost events could be anything
+            if (ev->mask & IN_Q_OVERFLOW) {
+                const uint64_t current = now();
+                for (auto& repo : mRepos) {
+                    if (!repo->pending())
+                        repo->firstEvent = current;
+                    repo->lastEvent = current;
+                    repo->rescan = true;
+                }
+                continue;
+            }
+            auto it = mWatches.find(ev->wd);
+            if (it == mWatches.end())
+                continue;
+            if (ev->mask & IN_IGNORED) {
+                mWatches.erase(it);
+                continue;
+            }
+            for (const Watch& watch : it->second) {
+                handleEvent(watch, ev->mask, ev->len ? ev->name : "");
+            }
+        }
+    }
+}
+
+void GitCache::handleEvent(const Watch& watch, uint32_t mask, const char* name)
+{
+    Repo& repo = *watch.repo;
+    const uint64_t current = now();
+    if (!repo.pending())
+        repo.firstEvent = current;
+    repo.lastEvent = current;
+
+    switch (watch.kind) {
+    case Watch::GitDir:
+        if (mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            repo.gone = true;
+        else if (!strcmp(name, "index"))
+            repo.reindex = true;
+        else if (!strcmp(name, "HEAD") || !strcmp(name, "packed-refs"))
+            repo.reread = true;
+        break;
+    case Watch::Refs:
+        repo.reread = true;
+        break;
+    case Watch::Worktree: {
+        if (!*name) {
+            if (watch.path.empty() && (mask & (IN_DELETE_SELF | IN_MOVE_SELF)))
+                repo.gone = true;
+            break;
+        }
+        // new ignores, or a nested repository coming or going
+        if (!strcmp(name, ".gitignore") || (!strcmp(name, ".git") && !watch.path.empty())) {
+            repo.rescan = true;
+            break;
+        }
+        if (!strcmp(name, ".git"))
+            break;
+        std::string path = watch.path + name;
+        if (mask & IN_ISDIR) {
+            path += '/';
+            if (mask & (IN_DELETE | IN_MOVED_FROM))
+                repo.goneDirs.insert(path);
+            if (mask & (IN_CREATE | IN_MOVED_TO))
+                repo.newDirs.insert(path);
+            break;
+        }
+        repo.paths.insert(std::move(path));
+        break; }
+    }
+}
+
+bool GitCache::watch(Repo& repo, Watch::Kind kind, const std::string& path)
+{
+    const std::string full = kind == Watch::Worktree ? repo.repo.worktree() + "/" + path : path;
+    uint32_t mask = IN_ONLYDIR | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE
+        | IN_DELETE_SELF | IN_MOVE_SELF;
+    // chmod and touch
+    if (kind == Watch::Worktree)
+        mask |= IN_ATTRIB;
+    const int wd = inotify_add_watch(mInotify, full.c_str(), mask);
+    if (wd == -1) {
+        // gone already is fine, anything else means we'd miss changes
+        if (errno != ENOENT && errno != ENOTDIR)
+            repo.failed = true;
+        return false;
+    }
+    auto& watches = mWatches[wd];
+    for (auto& w : watches) {
+        if (w.repo == &repo) {
+            w.kind = kind;
+            w.path = path;
+            return true;
+        }
+    }
+    watches.push_back({ &repo, kind, path });
+    return true;
+}
+
+void GitCache::watchDirectory(Repo& repo, GitRepo::Directory&& dir)
+{
+    watch(repo, Watch::Worktree, dir.path);
+    repo.directories[dir.path] = std::move(dir.ignores);
+}
+
+void GitCache::watchIndexDirectories(Repo& repo)
+{
+    std::string last;
+    for (const auto& entry : repo.index->entries()) {
+        // tracked files can be in directories the untracked walk skipped
+        std::string dir = directoryOf(entry.path);
+        if (dir == last)
+            continue;
+        last = dir;
+        if (!repo.directories.count(dir) && repo.ignoredDirectories.insert(dir).second)
+            watch(repo, Watch::Worktree, dir);
+    }
+}
+
+void GitCache::watchRefs(Repo& repo, const std::string& dir)
+{
+    if (!watch(repo, Watch::Refs, dir))
+        return;
+    int fd;
+    EINTRWRAP(fd, ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1)
+        return;
+    std::vector<std::string> subdirs;
+    DirScanner::forEachEntry(fd, [&](const char* name, DirScanner::Type type) {
+        struct stat st;
+        if (type == DirScanner::TypeDirectory || (type == DirScanner::TypeUnknown && fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode)))
+            subdirs.push_back(dir + "/" + name);
+    });
+    int e;
+    EINTRWRAP(e, ::close(fd));
+    for (const auto& sub : subdirs) {
+        watchRefs(repo, sub);
+    }
+}
+
+void GitCache::unwatch(Repo& repo, const std::string& prefix, bool all)
+{
+    for (auto it = mWatches.begin(); it != mWatches.end(); ) {
+        auto& watches = it->second;
+        watches.erase(std::remove_if(watches.begin(), watches.end(), [&](const Watch& w) {
+            return w.repo == &repo && (all || (w.kind == Watch::Worktree && startsWith(w.path, prefix)));
+        }), watches.end());
+        if (watches.empty()) {
+            inotify_rm_watch(mInotify, it->first);
+            it = mWatches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void GitCache::remove(Repo& repo)
+{
+    unwatch(repo, std::string(), true);
+    MutexLocker locker(&mMutex);
+    mSnapshots.erase(repo.repo.worktree());
+    if (repo.failed)
+        mFailed.insert(repo.repo.worktree());
+}
+
+bool GitCache::scan(Repo& repo)
+{
+    unwatch(repo, std::string(), true);
+    repo.clearPending();
+    repo.directories.clear();
+    repo.ignoredDirectories.clear();
+
+    // watch first so that nothing happening during the scan goes missing
+    const GitRepo& git = repo.repo;
+    if (!watch(repo, Watch::GitDir, git.gitDir()))
+        return false;
+    if (git.commonDir() != git.gitDir())
+        watch(repo, Watch::GitDir, git.commonDir());
+    watchRefs(repo, git.commonDir() + "/refs");
+
+    auto index = std::make_unique<GitIndex>();
+    const int err = git.loadIndex(*index);
+    if (err != 0 && err != ENOENT)
+        return false;
+    repo.index = std::move(index);
+
+    std::vector<GitRepo::Directory> visited;
+    std::vector<std::string> untracked;
+    git.findUntracked(*repo.index, { { std::string(), git.ignores() } }, untracked, &visited);
+    for (auto& dir : visited) {
+        watchDirectory(repo, std::move(dir));
+    }
+    watchIndexDirectories(repo);
+    repo.untracked = std::set<std::string>(untracked.begin(), untracked.end());
+    repo.converts = git.converts(*repo.index);
+    git.checkWorktree(*repo.index, repo.results);
+
+    repo.refs = GitRepo::Refs();
+    git.refs(repo.refs);
+    repo.head = git.head();
+
+    if (repo.failed)
+        return false;
+    publish(repo);
+    return true;
+}
+
+bool GitCache::checkUntracked(Repo& repo, const std::string& path)
+{
+    bool untracked = false;
+    auto dir = repo.directories.find(directoryOf(path));
+    if (dir != repo.directories.end()) {
+        struct stat st;
+        const std::string full = repo.repo.worktree() + "/" + path;
+        untracked = lstat(full.c_str(), &st) == 0 && !S_ISDIR(st.st_mode)
+            && !GitIgnoreStack::ignored(dir->second.get(), path, false);
+    }
+    if (untracked)
+        return repo.untracked.insert(path).second;
+    return repo.untracked.erase(path) > 0;
+}
+
+bool GitCache::update(Repo& repo)
+{
+    if (repo.rescan)
+        return scan(repo);
+
+    const GitRepo& git = repo.repo;
+    bool changed = false;
+
+    if (repo.reread) {
+        GitRepo::Refs refs;
+        git.refs(refs);
+        repo.refs = std::move(refs);
+        repo.head = git.head();
+        // new ref directories need watching
+        watchRefs(repo, git.commonDir() + "/refs");
+        changed = true;
+    }
+
+    if (repo.reindex) {
+        auto index = std::make_unique<GitIndex>();
+        const int err = git.loadIndex(*index);
+        if (err != 0 && err != ENOENT)
+            return scan(repo);
+        std::unique_ptr<GitIndex> old = std::move(repo.index);
+        repo.index = std::move(index);
+        // what was added isn't untracked anymore, what was removed might be
+        for (const auto& entry : repo.index->entries()) {
+            repo.untracked.erase(entry.path);
+        }
+        for (const auto& entry : old->entries()) {
+            if (!repo.index->contains(entry.path))
+                checkUntracked(repo, entry.path);
+        }
+        repo.converts = git.converts(*repo.index);
+        git.checkWorktree(*repo.index, repo.results);
+        watchIndexDirectories(repo);
+        changed = true;
+    }
+
+    const auto& entries = repo.index->entries();
+    auto recheckTracked = [&repo, &entries](const std::string& dir) {
+        const auto range = repo.index->range(dir);
+        for (size_t i = range.first; i < range.second; ++i) {
+            repo.paths.insert(entries[i].path);
+        }
+    };
+
+    for (const auto& dir : repo.goneDirs) {
+        unwatch(repo, dir);
+        for (auto it = repo.directories.begin(); it != repo.directories.end(); ) {
+            if (startsWith(it->first, dir))
+                it = repo.directories.erase(it);
+            else
+                ++it;
+        }
+        repo.ignoredDirectories.erase(repo.ignoredDirectories.lower_bound(dir),
+                                      std::find_if(repo.ignoredDirectories.lower_bound(dir), repo.ignoredDirectories.end(),
+                                                   [&dir](const std::string& d) { return !startsWith(d, dir); }));
+        auto first = repo.untracked.lower_bound(dir);
+        auto last = std::find_if(first, repo.untracked.end(), [&dir](const std::string& p) { return !startsWith(p, dir); });
+        if (first != last) {
+            repo.untracked.erase(first, last);
+            changed = true;
+        }
+        recheckTracked(dir);
+    }
+
+    for (const auto& dir : repo.newDirs) {
+        const std::string name = dir.substr(0, dir.size() - 1);
+        // submodules are in the index as the directory itself
+        if (repo.index->contains(name))
+            continue;
+        recheckTracked(dir);
+        auto parent = repo.directories.find(directoryOf(name));
+        if (parent == repo.directories.end() || GitIgnoreStack::ignored(parent->second.get(), name, true)) {
+            const auto range = repo.index->range(dir);
+            if (range.first != range.second && repo.ignoredDirectories.insert(dir).second)
+                watch(repo, Watch::Worktree, dir);
+            continue;
+        }
+        if (::access((git.worktree() + "/" + dir + ".git").c_str(), F_OK) == 0) {
+            changed = repo.untracked.insert(dir).second || changed;
+            continue;
+        }
+        std::vector<GitRepo::Directory> visited;
+        std::vector<std::string> untracked;
+        git.findUntracked(*repo.index, { { dir, parent->second } }, untracked, &visited);
+        for (auto& sub : visited) {
+            watchDirectory(repo, std::move(sub));
+        }
+        for (auto& path : untracked) {
+            changed = repo.untracked.insert(std::move(path)).second || changed;
+        }
+    }
+
+    // an edited attributes file can change how every file compares
+    if (std::any_of(repo.paths.begin(), repo.paths.end(), [](const std::string& path) {
+            return path == ".gitattributes" || (path.size() > 15 && path.compare(path.size() - 15, 15, "/.gitattributes") == 0);
+        })) {
+        const bool converts = git.converts(*repo.index);
+        if (converts != repo.converts) {
+            repo.converts = converts;
+            git.checkWorktree(*repo.index, repo.results);
+            changed = true;
+        }
+    }
+
+    for (const auto& path : repo.paths) {
+        const size_t idx = repo.index->find(path);
+        if (idx == entries.size()) {
+            changed = checkUntracked(repo, path) || changed;
+        } else if (!entries[idx].stage) {
+            const uint32_t result = git.check(*repo.index, idx, repo.converts);
+            if (result != repo.results[idx]) {
+                repo.results[idx] = result;
+                changed = true;
+            }
+        }
+    }
+
+    repo.clearPending();
+    if (repo.failed)
+        return false;
+    if (changed)
+        publish(repo);
+    return true;
+}
+
+void GitCache::publish(Repo& repo)
+{
+    // leave it to git until those are settled one way or the other
+    if (std::any_of(repo.results.begin(), repo.results.end(), [](uint32_t result) { return result & GitRepo::WorktreeUnknown; })) {
+        MutexLocker locker(&mMutex);
+        mSnapshots.erase(repo.repo.worktree());
+        return;
+    }
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->generation = ++mGeneration;
+    snapshot->worktree = repo.repo.worktree();
+    snapshot->head = repo.head;
+    snapshot->refs = repo.refs;
+    const auto& entries = repo.index->entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (repo.results[i])
+            snapshot->status.tracked.push_back({ repo.results[i], entries[i].path });
+    }
+    GitRepo::unmerged(*repo.index, snapshot->status.unmerged);
+    snapshot->status.untracked.assign(repo.untracked.begin(), repo.untracked.end());
+
+    MutexLocker locker(&mMutex);
+    mSnapshots[snapshot->worktree] = std::move(snapshot);
+}
+
+#else
+
+GitCache::GitCache()
+{
+}
+
+GitCache::~GitCache()
+{
+}
+
+std::shared_ptr<const GitCache::Snapshot> GitCache::snapshot(const std::string&, std::string&)
+{
+    return nullptr;
+}
+
+void GitCache::stop()
+{
+}
+
+#endif
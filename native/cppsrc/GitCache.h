@@ -0,0 +1,105 @@
+#ifndef GITCACHE_H
+#define GITCACHE_H
+
+#include "GitRepo.h"
+#include "utils.h"
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <uv.h>
+
+// a snapshot of every repository asked about, kept up to date by a thread
+// of its own from inotify events on the worktree and the git dir. events
+// are applied once things settle down: a changed file gets one lstat,
+// a new directory gets walked, a new index gets every entry checked and
+// new refs get reread. queries only take a lock and copy a pointer.
+// Linux only, elsewhere there's never a snapshot
+class GitCache
+{
+public:
+    struct Snapshot
+    {
+        // bumped every time anything in here changes
+        uint64_t generation;
+        std::string worktree, head;
+        // paths relative to the worktree, untracked ones sorted
+        GitRepo::Status status;
+        GitRepo::Refs refs;
+    };
+
+    enum {
+        MaxRepos = 8,
+        // events are applied after this many ms without new ones
+        SettleTime = 20,
+        // or at the latest this long after the first one
+        MaxDelay = 250
+    };
+
+    GitCache();
+    ~GitCache();
+
+    // the snapshot for the repository path is in, prefix is set to path
+    // relative to the worktree. the first query for a repository starts
+    // watching it and returns null, so does one that can't be watched
+    std::shared_ptr<const Snapshot> snapshot(const std::string& path, std::string& prefix);
+
+    void stop();
+
+private:
+    struct Repo;
+    struct Watch
+    {
+        enum Kind { Worktree, GitDir, Refs };
+        Repo* repo;
+        Kind kind;
+        // the worktree directory, "" or "dir/sub/"
+        std::string path;
+    };
+
+    static void run(void* arg);
+    void process();
+    void wakeup();
+    void drainEvents();
+    void handleEvent(const Watch& watch, uint32_t mask, const char* name);
+
+    // false if the repository has to be dropped
+    bool scan(Repo& repo);
+    bool update(Repo& repo);
+    void publish(Repo& repo);
+    void remove(Repo& repo);
+    bool watch(Repo& repo, Watch::Kind kind, const std::string& path);
+    void watchDirectory(Repo& repo, GitRepo::Directory&& dir);
+    void watchIndexDirectories(Repo& repo);
+    void watchRefs(Repo& repo, const std::string& dir);
+    // every watch of the repository if all is set, otherwise the
+    // worktree directories starting with prefix
+    void unwatch(Repo& repo, const std::string& prefix, bool all = false);
+    // true if the untracked set changed
+    bool checkUntracked(Repo& repo, const std::string& path);
+
+    // shared with the js thread
+    Mutex mMutex;
+    // directory -> worktree and prefix
+    std::unordered_map<std::string, std::pair<std::string, std::string> > mLookups;
+    std::unordered_map<std::string, std::shared_ptr<const Snapshot> > mSnapshots;
+    std::unordered_map<std::string, uint64_t> mUsed;
+    std::vector<std::string> mRequests;
+    // worktrees we gave up on
+    std::set<std::string> mFailed;
+    uint64_t mUseCounter { 0 };
+    bool mStarted { false }, mStopped { false };
+
+    // the watcher thread's own
+    uv_thread_t mThread;
+    int mInotify { -1 };
+    int mWakeup[2] { -1, -1 };
+    std::vector<std::unique_ptr<Repo> > mRepos;
+    // linked worktrees share a common dir, so a watch can serve several
+    std::unordered_map<int, std::vector<Watch> > mWatches;
+    uint64_t mGeneration { 0 };
+};
+
+#endif
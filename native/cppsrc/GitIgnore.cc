@@ -0,0 +1,188 @@
+#include "GitIgnore.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+bool GitIgnore::load(const std::string& file, const std::string& base)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1)
+        return false;
+    std::string data;
+    char buf[16384];
+    for (;;) {
+        ssize_t r;
+        EINTRWRAP(r, ::read(fd, buf, sizeof(buf)));
+        if (r <= 0)
+            break;
+        data.append(buf, r);
+    }
+    int e;
+    EINTRWRAP(e, ::close(fd));
+    parse(data, base);
+    return true;
+}
+
+void GitIgnore::parse(std::string_view data, const std::string& base)
+{
+    mBase = base;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string_view::npos)
+            eol = data.size();
+        std::string_view line = data.substr(pos, eol - pos);
+        pos = eol + 1;
+
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        // trailing spaces go unless escaped
+        while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\'))
+            line.remove_suffix(1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        Pattern pattern { std::string(), false, false, false };
+        if (line[0] == '!') {
+            pattern.negate = true;
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            pattern.directoryOnly = true;
+            line.remove_suffix(1);
+        }
+        // a slash anywhere but at the end ties the pattern to this directory
+        pattern.anchored = line.find('/') != std::string_view::npos;
+        if (!line.empty() && line[0] == '/')
+            line.remove_prefix(1);
+        if (line.empty())
+            continue;
+        pattern.pattern = line;
+        mPatterns.push_back(std::move(pattern));
+    }
+}
+
+GitIgnore::Result GitIgnore::match(std::string_view path, bool isDirectory) const
+{
+    if (path.size() <= mBase.size() || path.compare(0, mBase.size(), mBase) != 0)
+        return NoMatch;
+    const std::string_view relative = path.substr(mBase.size());
+    const size_t slash = relative.rfind('/');
+    const std::string_view name = slash == std::string_view::npos ? relative : relative.substr(slash + 1);
+
+    for (auto it = mPatterns.rbegin(); it != mPatterns.rend(); ++it) {
+        if (it->directoryOnly && !isDirectory)
+            continue;
+        if (wildmatch(it->pattern, it->anchored ? relative : name))
+            return it->negate ? NotIgnored : Ignored;
+    }
+    return NoMatch;
+}
+
+bool GitIgnoreStack::ignored(const GitIgnoreStack* stack, std::string_view path, bool isDirectory)
+{
+    for (; stack; stack = stack->parent.get()) {
+        const GitIgnore::Result result = stack->ignore.match(path, isDirectory);
+        if (result != GitIgnore::NoMatch)
+            return result == GitIgnore::Ignored;
+    }
+    return false;
+}
+
+// p points past the '[', left past the ']'
+static bool matchClass(const char*& p, const char* pe, char c)
+{
+    bool negate = false;
+    if (p < pe && (*p == '!' || *p == '^')) {
+        negate = true;
+        ++p;
+    }
+    bool matched = false;
+    // a ']' right after the '[' is literal
+    for (bool first = true; p < pe && (first || *p != ']'); first = false) {
+        char lo = *p++;
+        if (lo == '\\' && p < pe)
+            lo = *p++;
+        if (p + 1 < pe && *p == '-' && p[1] != ']') {
+            char hi = p[1];
+            p += 2;
+            if (hi == '\\' && p < pe)
+                hi = *p++;
+            if (c >= lo && c <= hi)
+                matched = true;
+        } else if (c == lo) {
+            matched = true;
+        }
+    }
+    if (p >= pe)
+        return false;
+    ++p;
+    return matched != negate;
+}
+
+static bool wildmatch(const char* ps, const char* p, const char* pe, const char* t, const char* te)
+{
+    while (p < pe) {
+        switch (*p) {
+        case '*':
+            if (p + 1 < pe && p[1] == '*' && (p == ps || p[-1] == '/') && (p + 2 == pe || p[2] == '/')) {
+                // a trailing "/**" matches everything inside
+                if (p + 2 == pe)
+                    return true;
+                // "**/" matches nothing or any number of directories
+                p += 3;
+                for (const char* s = t;;) {
+                    if (wildmatch(ps, p, pe, s, te))
+                        return true;
+                    s = static_cast<const char*>(memchr(s, '/', te - s));
+                    if (!s)
+                        return false;
+                    ++s;
+                }
+            }
+            // any other run of stars stays within one path component
+            while (p < pe && *p == '*')
+                ++p;
+            for (const char* s = t;; ++s) {
+                if (wildmatch(ps, p, pe, s, te))
+                    return true;
+                if (s == te || *s == '/')
+                    return false;
+            }
+        case '?':
+            if (t == te || *t == '/')
+                return false;
+            ++p;
+            ++t;
+            break;
+        case '[':
+            if (t == te || *t == '/')
+                return false;
+            ++p;
+            if (!matchClass(p, pe, *t))
+                return false;
+            ++t;
+            break;
+        case '\\':
+            if (p + 1 < pe)
+                ++p;
+            // fall through
+        default:
+            if (t == te || *t != *p)
+                return false;
+            ++p;
+            ++t;
+            break;
+        }
+    }
+    return t == te;
+}
+
+bool GitIgnore::wildmatch(std::string_view pattern, std::string_view text)
+{
+    const char* p = pattern.data();
+    const char* t = text.data();
+    return ::wildmatch(p, p, p + pattern.size(), t, t + text.size());
+}
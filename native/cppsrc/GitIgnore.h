@@ -0,0 +1,50 @@
+#ifndef GITIGNORE_H
+#define GITIGNORE_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the patterns of one .gitignore (or info/exclude, or the global
+// excludes file), matched the way gitignore(5) describes
+class GitIgnore
+{
+public:
+    enum Result { NoMatch, Ignored, NotIgnored };
+
+    // base is the directory the file applies to relative to the
+    // worktree, "" for the top level and "dir/sub/" otherwise
+    bool load(const std::string& file, const std::string& base);
+    void parse(std::string_view data, const std::string& base);
+
+    bool empty() const { return mPatterns.empty(); }
+
+    // path is relative to the worktree, the last matching pattern wins
+    Result match(std::string_view path, bool isDirectory) const;
+
+    // fnmatch with FNM_PATHNAME plus git's "**" for any number of directories
+    static bool wildmatch(std::string_view pattern, std::string_view text);
+
+private:
+    struct Pattern
+    {
+        std::string pattern;
+        bool negate, directoryOnly, anchored;
+    };
+
+    std::string mBase;
+    std::vector<Pattern> mPatterns;
+};
+
+// ignore files from the deepest directory up, then info/exclude and the
+// global excludes. the first one with an opinion decides
+struct GitIgnoreStack
+{
+    std::shared_ptr<const GitIgnoreStack> parent;
+    GitIgnore ignore;
+
+    static bool ignored(const GitIgnoreStack* stack, std::string_view path, bool isDirectory);
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "GitIndex.h"
+#include "utils.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+static inline uint32_t be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint16_t be16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+GitIndex::~GitIndex()
+{
+    if (mData)
+        munmap(mData, mSize);
+}
+
+int GitIndex::load(const std::string& file, size_t hashSize)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1)
+        return errno;
+    struct stat st;
+    int e;
+    if (fstat(fd, &st) == -1) {
+        const int err = errno;
+        EINTRWRAP(e, ::close(fd));
+        return err;
+    }
+    mMtime = st.st_mtim;
+    mSize = st.st_size;
+    if (mSize < 12 + hashSize) {
+        EINTRWRAP(e, ::close(fd));
+        return EINVAL;
+    }
+    mData = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    EINTRWRAP(e, ::close(fd));
+    if (mData == MAP_FAILED) {
+        mData = nullptr;
+        return errno;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(mData);
+    const uint8_t* end = data + mSize - hashSize;
+    if (memcmp(data, "DIRC", 4) != 0)
+        return EINVAL;
+    const uint32_t version = be32(data + 4);
+    if (version < 2 || version > 4)
+        return EINVAL;
+    const uint32_t count = be32(data + 8);
+    // every entry takes at least this much, don't let a corrupt
+    // count allocate more than the file could possibly hold
+    if (count > (mSize - 12 - hashSize) / (40 + hashSize + 2))
+        return EINVAL;
+
+    mEntries.resize(count);
+    const uint8_t* p = data + 12;
+    std::string_view previous;
+    for (uint32_t i = 0; i < count; ++i) {
+        Entry& entry = mEntries[i];
+        const uint8_t* start = p;
+        if (end - p < static_cast<ptrdiff_t>(40 + hashSize + 2))
+            return EINVAL;
+        entry.ctimeSec = be32(p);
+        entry.ctimeNsec = be32(p + 4);
+        entry.mtimeSec = be32(p + 8);
+        entry.mtimeNsec = be32(p + 12);
+        // dev isn't compared, git doesn't by default either
+        entry.ino = be32(p + 20);
+        entry.mode = be32(p + 24);
+        entry.uid = be32(p + 28);
+        entry.gid = be32(p + 32);
+        entry.size = be32(p + 36);
+        entry.hash = p + 40;
+        p += 40 + hashSize;
+        const uint16_t flags = be16(p);
+        p += 2;
+        entry.assumeValid = (flags & 0x8000) != 0;
+        entry.stage = (flags >> 12) & 0x3;
+        entry.skipWorktree = entry.intentToAdd = false;
+        if (version >= 3 && (flags & 0x4000)) {
+            if (end - p < 2)
+                return EINVAL;
+            const uint16_t extended = be16(p);
+            p += 2;
+            entry.skipWorktree = (extended & 0x4000) != 0;
+            entry.intentToAdd = (extended & 0x2000) != 0;
+        }
+
+        if (version == 4) {
+            // the number of bytes to drop from the end of the previous
+            // path, then what to append to it
+            size_t strip = 0;
+            uint8_t c;
+            if (p == end)
+                return EINVAL;
+            c = *p++;
+            strip = c & 0x7f;
+            while (c & 0x80) {
+                if (p == end)
+                    return EINVAL;
+                c = *p++;
+                strip = ((strip + 1) << 7) | (c & 0x7f);
+            }
+            const uint8_t* nul = static_cast<const uint8_t*>(memchr(p, '\0', end - p));
+            if (!nul || strip > previous.size())
+                return EINVAL;
+            entry.path.reserve(previous.size() - strip + (nul - p));
+            entry.path.assign(previous.substr(0, previous.size() - strip));
+            entry.path.append(reinterpret_cast<const char*>(p), nul - p);
+            p = nul + 1;
+        } else {
+            const uint8_t* nul = static_cast<const uint8_t*>(memchr(p, '\0', end - p));
+            if (!nul)
+                return EINVAL;
+            entry.path.assign(reinterpret_cast<const char*>(p), nul - p);
+            // entries are padded with 1-8 nuls to a multiple of 8 bytes
+            const size_t length = ((nul - start) + 8) & ~static_cast<size_t>(7);
+            if (static_cast<size_t>(end - start) < length)
+                return EINVAL;
+            p = start + length;
+        }
+        previous = entry.path;
+    }
+
+    // with a split index the entries here are only part of the story
+    while (end - p >= 8) {
+        if (memcmp(p, "link", 4) == 0)
+            return EINVAL;
+        const uint32_t size = be32(p + 4);
+        if (static_cast<size_t>(end - p - 8) < size)
+            break;
+        p += 8 + size;
+    }
+    return 0;
+}
+
+size_t GitIndex::find(std::string_view path) const
+{
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), path, [](const Entry& entry, std::string_view p) {
+        return std::string_view(entry.path) < p;
+    });
+    return it != mEntries.end() && it->path == path ? it - mEntries.begin() : mEntries.size();
+}
+
+std::pair<size_t, size_t> GitIndex::range(std::string_view dir) const
+{
+    auto less = [](const Entry& entry, std::string_view p) {
+        return std::string_view(entry.path) < p;
+    };
+    auto first = std::lower_bound(mEntries.begin(), mEntries.end(), dir, less);
+    auto last = std::partition_point(first, mEntries.end(), [dir](const Entry& entry) {
+        return entry.path.compare(0, dir.size(), dir) == 0;
+    });
+    return std::make_pair(static_cast<size_t>(first - mEntries.begin()), static_cast<size_t>(last - mEntries.begin()));
+}
@@ -0,0 +1,62 @@
+#ifndef GITINDEX_H
+#define GITINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <time.h>
+
+// .git/index mapped and parsed, see gitformat-index(5). versions 2 to 4
+// are supported, split indexes aren't
+class GitIndex
+{
+public:
+    struct Entry
+    {
+        enum {
+            ModeType = 0170000,
+            ModeFile = 0100000,
+            ModeSymlink = 0120000,
+            ModeGitlink = 0160000
+        };
+
+        uint32_t ctimeSec, ctimeNsec, mtimeSec, mtimeNsec;
+        uint32_t ino, mode, uid, gid, size;
+        // points into the mapped index
+        const uint8_t* hash;
+        uint8_t stage;
+        bool assumeValid, skipWorktree, intentToAdd;
+        std::string path;
+    };
+
+    GitIndex() = default;
+    ~GitIndex();
+
+    GitIndex(const GitIndex&) = delete;
+    GitIndex& operator=(const GitIndex&) = delete;
+
+    // 0 or an errno value
+    int load(const std::string& file, size_t hashSize);
+
+    // sorted by path, then stage
+    const std::vector<Entry>& entries() const { return mEntries; }
+    // when the index was written, for racy timestamps
+    const struct timespec& mtime() const { return mMtime; }
+
+    // the first entry for path in any stage, entries().size() if there's none
+    size_t find(std::string_view path) const;
+    bool contains(std::string_view path) const { return find(path) < mEntries.size(); }
+    // the entries under a directory, dir ends with a slash
+    std::pair<size_t, size_t> range(std::string_view dir) const;
+
+private:
+    std::vector<Entry> mEntries;
+    struct timespec mMtime { 0, 0 };
+    void* mData { nullptr };
+    size_t mSize { 0 };
+};
+
+#endif
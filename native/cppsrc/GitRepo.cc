@@ -0,0 +1,685 @@
+#include "GitRepo.h"
+#include "DirScanner.h"
+#include "Sha1.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+static bool readFile(const std::string& path, std::string& data)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1)
+        return false;
+    data.clear();
+    char buf[16384];
+    ssize_t r;
+    for (;;) {
+        EINTRWRAP(r, ::read(fd, buf, sizeof(buf)));
+        if (r <= 0)
+            break;
+        data.append(buf, r);
+    }
+    int e;
+    EINTRWRAP(e, ::close(fd));
+    return r == 0;
+}
+
+static std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.front())))
+        str.remove_prefix(1);
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.back())))
+        str.remove_suffix(1);
+    return str;
+}
+
+static std::string lower(std::string_view str)
+{
+    std::string ret(str);
+    for (char& c : ret) {
+        c = tolower(static_cast<unsigned char>(c));
+    }
+    return ret;
+}
+
+static bool startsWith(std::string_view str, std::string_view prefix)
+{
+    return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// the last value of section.key in a git config file, subsections and
+// includes aren't supported
+static std::string configValue(const std::string& file, const char* section, const char* key)
+{
+    std::string data, value;
+    if (!readFile(file, data))
+        return value;
+    bool inSection = false;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = data.size();
+        const std::string_view line = trim(std::string_view(data).substr(pos, eol - pos));
+        pos = eol + 1;
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+        if (line[0] == '[') {
+            const size_t end = line.find_first_of(" \"]");
+            inSection = lower(line.substr(1, end == std::string_view::npos ? std::string_view::npos : end - 1)) == section;
+            continue;
+        }
+        if (!inSection)
+            continue;
+        const size_t eq = line.find('=');
+        if (lower(trim(line.substr(0, eq))) != key)
+            continue;
+        // a key without a value is a boolean true
+        std::string_view v = eq == std::string_view::npos ? std::string_view("true") : trim(line.substr(eq + 1));
+        if (v.size() >= 2 && v.front() == '"' && v.back() == '"')
+            v = v.substr(1, v.size() - 2);
+        value = v;
+    }
+    return value;
+}
+
+static bool isFalse(const std::string& value)
+{
+    const std::string v = lower(value);
+    return v == "false" || v == "no" || v == "off" || v == "0";
+}
+
+// whether an attributes file turns on anything that can make a checkout
+// differ from its blob. patterns aren't matched, any line will do
+static bool attributesConvert(const std::string& file)
+{
+    std::string data;
+    if (file.empty() || !readFile(file, data))
+        return false;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t eol = data.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = data.size();
+        std::string_view line = trim(std::string_view(data).substr(pos, eol - pos));
+        pos = eol + 1;
+        if (line.empty() || line[0] == '#')
+            continue;
+        // skip the pattern, which may be quoted
+        size_t end = line[0] == '"' ? line.find('"', 1) : line.find_first_of(" \t");
+        if (end == std::string_view::npos)
+            continue;
+        line.remove_prefix(end + 1);
+        while (!line.empty()) {
+            line = trim(line);
+            end = line.find_first_of(" \t");
+            const std::string_view attr = line.substr(0, end);
+            line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+            if (attr.empty() || attr[0] == '-' || attr[0] == '!')
+                continue;
+            const std::string_view name = attr.substr(0, attr.find('='));
+            if (name == "text" || name == "eol" || name == "crlf" || name == "filter"
+                || name == "ident" || name == "working-tree-encoding") {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static std::string expandHome(const std::string& path)
+{
+    if (!startsWith(path, "~/"))
+        return path;
+    const char* home = getenv("HOME");
+    return home ? std::string(home) + path.substr(1) : path;
+}
+
+bool GitRepo::open(const std::string& path)
+{
+    // leave anything configured through the environment to git itself
+    if (getenv("GIT_DIR") || getenv("GIT_WORK_TREE") || getenv("GIT_INDEX_FILE") || getenv("GIT_COMMON_DIR"))
+        return false;
+
+    char* real = realpath(path.c_str(), nullptr);
+    if (!real)
+        return false;
+    const std::string dir(real);
+    free(real);
+    // inside the git dir itself there's no worktree
+    if (dir.find("/.git/") != std::string::npos || (dir.size() >= 5 && dir.compare(dir.size() - 5, 5, "/.git") == 0))
+        return false;
+
+    std::string cur = dir;
+    for (;;) {
+        const std::string dotgit = cur + (cur == "/" ? ".git" : "/.git");
+        struct stat st;
+        if (::stat(dotgit.c_str(), &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                mGitDir = dotgit;
+                break;
+            }
+            // a linked worktree or a submodule
+            std::string data;
+            if (S_ISREG(st.st_mode) && readFile(dotgit, data) && startsWith(data, "gitdir: ")) {
+                const std::string_view gitdir = trim(std::string_view(data).substr(8));
+                if (gitdir.empty())
+                    return false;
+                mGitDir = gitdir[0] == '/' ? std::string(gitdir) : cur + "/" + std::string(gitdir);
+                break;
+            }
+        }
+        if (cur == "/")
+            return false;
+        const size_t slash = cur.rfind('/');
+        cur = slash ? cur.substr(0, slash) : std::string("/");
+    }
+
+    if (::access((mGitDir + "/HEAD").c_str(), F_OK) != 0)
+        return false;
+
+    std::string common;
+    if (readFile(mGitDir + "/commondir", common)) {
+        const std::string_view c = trim(common);
+        if (c.empty())
+            return false;
+        mCommonDir = c[0] == '/' ? std::string(c) : mGitDir + "/" + std::string(c);
+    } else {
+        mCommonDir = mGitDir;
+    }
+
+    const std::string config = mCommonDir + "/config";
+    const std::string bare = configValue(config, "core", "bare");
+    if (!bare.empty() && !isFalse(bare))
+        return false;
+    if (!configValue(config, "core", "worktree").empty())
+        return false;
+    if (lower(configValue(config, "extensions", "objectformat")) == "sha256")
+        mHashSize = 32;
+    mFileMode = !isFalse(configValue(config, "core", "filemode"));
+    mExcludesFile = expandHome(configValue(config, "core", "excludesfile"));
+    if (mExcludesFile.empty()) {
+        const char* home = getenv("HOME");
+        if (home)
+            mExcludesFile = expandHome(configValue(std::string(home) + "/.gitconfig", "core", "excludesfile"));
+    }
+    if (mExcludesFile.empty()) {
+        const char* xdg = getenv("XDG_CONFIG_HOME");
+        const char* home = getenv("HOME");
+        if (xdg && *xdg)
+            mExcludesFile = std::string(xdg) + "/git/ignore";
+        else if (home)
+            mExcludesFile = std::string(home) + "/.config/git/ignore";
+    }
+
+    mWorktree = cur;
+    if (dir.size() > cur.size())
+        mPrefix = dir.substr(cur == "/" ? 1 : cur.size() + 1) + "/";
+    else
+        mPrefix.clear();
+
+    // the repository config wins over the global ones, which win over the system one
+    const char* home = getenv("HOME");
+    const char* xdg = getenv("XDG_CONFIG_HOME");
+    const std::string xdgDir = xdg && *xdg ? std::string(xdg) + "/git" : home ? std::string(home) + "/.config/git" : std::string();
+    std::string autocrlf, attributesFile;
+    for (const std::string& file : { config, home ? std::string(home) + "/.gitconfig" : std::string(),
+                                     xdgDir.empty() ? std::string() : xdgDir + "/config", std::string("/etc/gitconfig") }) {
+        if (file.empty())
+            continue;
+        if (autocrlf.empty())
+            autocrlf = configValue(file, "core", "autocrlf");
+        if (attributesFile.empty())
+            attributesFile = expandHome(configValue(file, "core", "attributesfile"));
+    }
+    if (attributesFile.empty() && !xdgDir.empty())
+        attributesFile = xdgDir + "/attributes";
+    mConverts = (!autocrlf.empty() && !isFalse(autocrlf))
+        || attributesConvert(attributesFile)
+        || attributesConvert(mCommonDir + "/info/attributes");
+    return true;
+}
+
+std::string GitRepo::relative(const std::string& prefix, const std::string& path)
+{
+    // the directories both have in common, then up from prefix and down to path
+    size_t common = 0;
+    for (size_t i = 0; i < prefix.size() && i < path.size() && prefix[i] == path[i]; ++i) {
+        if (prefix[i] == '/')
+            common = i + 1;
+    }
+    std::string ret;
+    for (size_t i = common; i < prefix.size(); ++i) {
+        if (prefix[i] == '/')
+            ret += "../";
+    }
+    ret.append(path, common, std::string::npos);
+    return ret;
+}
+
+std::string GitRepo::head() const
+{
+    std::string data;
+    if (!readFile(mGitDir + "/HEAD", data))
+        return std::string();
+    const std::string_view value = trim(data);
+    if (startsWith(value, "ref:")) {
+        std::string_view ref = trim(value.substr(4));
+        if (startsWith(ref, "refs/heads/"))
+            ref.remove_prefix(11);
+        return std::string(ref);
+    }
+    return std::string(value.substr(0, 7));
+}
+
+int GitRepo::loadIndex(GitIndex& index) const
+{
+    return index.load(mGitDir + "/index", mHashSize);
+}
+
+bool GitRepo::converts(const GitIndex& index) const
+{
+    // the top level one counts even when it's untracked
+    if (mConverts || attributesConvert(mWorktree + "/.gitattributes"))
+        return true;
+    static const std::string_view name = ".gitattributes";
+    for (const auto& entry : index.entries()) {
+        const std::string& path = entry.path;
+        if (path.size() < name.size() || path.compare(path.size() - name.size(), name.size(), name) != 0
+            || (path.size() > name.size() && path[path.size() - name.size() - 1] != '/')) {
+            continue;
+        }
+        const std::string file = mWorktree + "/" + path;
+        // git falls back to the one in the index, which we can't read
+        if (::access(file.c_str(), F_OK) != 0 || attributesConvert(file))
+            return true;
+    }
+    return false;
+}
+
+static bool hashMatches(const std::string& file, const struct stat& st, const uint8_t* expected)
+{
+    Sha1 sha;
+    char header[32];
+    const int n = snprintf(header, sizeof(header), "blob %llu", static_cast<unsigned long long>(st.st_size));
+    sha.update(header, n + 1);
+
+    if (S_ISLNK(st.st_mode)) {
+        char target[PATH_MAX];
+        const ssize_t r = readlink(file.c_str(), target, sizeof(target));
+        if (r != st.st_size)
+            return false;
+        sha.update(target, r);
+    } else {
+        int fd;
+        EINTRWRAP(fd, ::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd == -1)
+            return false;
+        char buf[65536];
+        ssize_t r;
+        off_t total = 0;
+        for (;;) {
+            EINTRWRAP(r, ::read(fd, buf, sizeof(buf)));
+            if (r <= 0)
+                break;
+            sha.update(buf, r);
+            total += r;
+        }
+        int e;
+        EINTRWRAP(e, ::close(fd));
+        if (r < 0 || total != st.st_size)
+            return false;
+    }
+
+    uint8_t digest[Sha1::DigestSize];
+    sha.final(digest);
+    return memcmp(digest, expected, Sha1::DigestSize) == 0;
+}
+
+template<typename Func>
+static void parallel(size_t count, size_t chunk, Func&& func)
+{
+    std::atomic<size_t> next { 0 };
+    auto work = [&]() {
+        for (;;) {
+            const size_t start = next.fetch_add(chunk);
+            if (start >= count)
+                break;
+            const size_t end = std::min(count, start + chunk);
+            for (size_t i = start; i < end; ++i) {
+                func(i);
+            }
+        }
+    };
+    const size_t chunks = (count + chunk - 1) / chunk;
+    const size_t threads = std::min<size_t>({ chunks, GitRepo::MaxThreads, std::max(1u, std::thread::hardware_concurrency()) });
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+uint32_t GitRepo::check(const GitIndex& index, size_t idx, bool converts) const
+{
+    const GitIndex::Entry& entry = index.entries()[idx];
+    const uint32_t type = entry.mode & GitIndex::Entry::ModeType;
+    if (entry.stage || entry.assumeValid || entry.skipWorktree || entry.intentToAdd || type == GitIndex::Entry::ModeGitlink)
+        return 0;
+
+    const std::string file = mWorktree + "/" + entry.path;
+    struct stat st;
+    if (lstat(file.c_str(), &st) == -1)
+        return errno == ENOENT || errno == ENOTDIR ? WorktreeDeleted : 0;
+    if (S_ISDIR(st.st_mode))
+        return WorktreeDeleted;
+    if (S_ISLNK(st.st_mode) != (type == GitIndex::Entry::ModeSymlink)
+        || (mFileMode && S_ISREG(st.st_mode) && ((st.st_mode & 0100) != 0) != ((entry.mode & 0100) != 0))) {
+        return WorktreeChanged;
+    }
+    // a filtered file can differ from its blob in size too
+    const uint32_t differs = converts && S_ISREG(st.st_mode) ? static_cast<uint32_t>(WorktreeUnknown) : static_cast<uint32_t>(WorktreeChanged);
+    if (static_cast<uint32_t>(st.st_size) != entry.size)
+        return differs;
+
+    const bool statClean = static_cast<uint32_t>(st.st_mtim.tv_sec) == entry.mtimeSec
+        && static_cast<uint32_t>(st.st_mtim.tv_nsec) == entry.mtimeNsec
+        && static_cast<uint32_t>(st.st_ctim.tv_sec) == entry.ctimeSec
+        && static_cast<uint32_t>(st.st_ino) == entry.ino
+        && static_cast<uint32_t>(st.st_uid) == entry.uid
+        && static_cast<uint32_t>(st.st_gid) == entry.gid;
+    // a file written in the same second as the index could have
+    // changed without its stat data doing so
+    const struct timespec& written = index.mtime();
+    const bool racy = entry.mtimeSec > static_cast<uint32_t>(written.tv_sec)
+        || (entry.mtimeSec == static_cast<uint32_t>(written.tv_sec)
+            && entry.mtimeNsec >= static_cast<uint32_t>(written.tv_nsec));
+    if (statClean && !racy)
+        return 0;
+
+    // same size but touched, only the contents can tell
+    if (mHashSize != Sha1::DigestSize || !hashMatches(file, st, entry.hash))
+        return differs;
+    return 0;
+}
+
+void GitRepo::checkWorktree(const GitIndex& index, std::vector<uint32_t>& results) const
+{
+    const bool conv = converts(index);
+    results.assign(index.entries().size(), 0);
+    parallel(results.size(), 256, [&](size_t i) {
+        results[i] = check(index, i, conv);
+    });
+}
+
+void GitRepo::unmerged(const GitIndex& index, std::vector<Entry>& unmerged)
+{
+    // stages 1, 2 and 3 are base, ours and theirs. which ones are there
+    // decides the status, the enum is ordered by that mask
+    const auto& entries = index.entries();
+    for (size_t i = 0; i < entries.size(); ) {
+        if (!entries[i].stage) {
+            ++i;
+            continue;
+        }
+        uint32_t mask = 0;
+        size_t j = i;
+        for (; j < entries.size() && entries[j].path == entries[i].path; ++j) {
+            if (entries[j].stage)
+                mask |= 1u << (entries[j].stage - 1);
+        }
+        unmerged.push_back({ mask - 1, entries[i].path });
+        i = j;
+    }
+}
+
+std::shared_ptr<const GitIgnoreStack> GitRepo::ignores() const
+{
+    std::shared_ptr<const GitIgnoreStack> base;
+    for (const std::string& file : { mExcludesFile, mCommonDir + "/info/exclude" }) {
+        auto stack = std::make_shared<GitIgnoreStack>();
+        if (file.empty() || !stack->ignore.load(file, std::string()) || stack->ignore.empty())
+            continue;
+        stack->parent = base;
+        base = stack;
+    }
+    return base;
+}
+
+void GitRepo::findUntracked(const GitIndex& index, std::vector<Directory> level,
+                            std::vector<std::string>& untracked, std::vector<Directory>* visited) const
+{
+    // breadth first, each level of directories spread over the threads
+    while (!level.empty()) {
+        std::vector<std::vector<Directory> > subdirs(level.size());
+        std::vector<std::vector<std::string> > found(level.size());
+        std::vector<char> opened(level.size(), 0);
+
+        parallel(level.size(), 1, [&](size_t i) {
+            Directory& dir = level[i];
+            const std::string full = mWorktree + "/" + dir.path;
+            int fd;
+            EINTRWRAP(fd, ::open(full.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (fd == -1)
+                return;
+            opened[i] = 1;
+
+            {
+                auto stack = std::make_shared<GitIgnoreStack>();
+                if (stack->ignore.load(full + ".gitignore", dir.path) && !stack->ignore.empty()) {
+                    stack->parent = dir.ignores;
+                    dir.ignores = stack;
+                }
+            }
+            const GitIgnoreStack* ignores = dir.ignores.get();
+
+            DirScanner::forEachEntry(fd, [&](const char* name, DirScanner::Type type) {
+                if (!strcmp(name, ".git"))
+                    return;
+                if (type == DirScanner::TypeUnknown) {
+                    struct stat st;
+                    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+                        return;
+                    type = S_ISDIR(st.st_mode) ? DirScanner::TypeDirectory : DirScanner::TypeFile;
+                }
+                std::string path = dir.path + name;
+                if (type == DirScanner::TypeDirectory) {
+                    // submodules are in the index as the directory itself
+                    if (index.contains(path) || GitIgnoreStack::ignored(ignores, path, true))
+                        return;
+                    path += '/';
+                    // a repository of its own shows up as just the directory
+                    if (faccessat(fd, (std::string(name) + "/.git").c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+                        found[i].push_back(std::move(path));
+                        return;
+                    }
+                    subdirs[i].push_back({ std::move(path), dir.ignores });
+                    return;
+                }
+                if (!index.contains(path) && !GitIgnoreStack::ignored(ignores, path, false))
+                    found[i].push_back(std::move(path));
+            });
+
+            int e;
+            EINTRWRAP(e, ::close(fd));
+        });
+
+        std::vector<Directory> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            for (auto& path : found[i]) {
+                untracked.push_back(std::move(path));
+            }
+            for (auto& sub : subdirs[i]) {
+                next.push_back(std::move(sub));
+            }
+            if (visited && opened[i])
+                visited->push_back(std::move(level[i]));
+        }
+        level = std::move(next);
+    }
+}
+
+bool GitRepo::status(Status& status) const
+{
+    GitIndex index;
+    const int err = loadIndex(index);
+    // a repository without any commits or adds has no index yet
+    if (err != 0 && err != ENOENT)
+        return false;
+
+    std::vector<uint32_t> results;
+    checkWorktree(index, results);
+    const auto& entries = index.entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (results[i] & WorktreeUnknown)
+            return false;
+        if (results[i])
+            status.tracked.push_back({ results[i], relative(mPrefix, entries[i].path) });
+    }
+
+    unmerged(index, status.unmerged);
+    for (auto& entry : status.unmerged) {
+        entry.path = relative(mPrefix, entry.path);
+    }
+
+    findUntracked(index, { { std::string(), ignores() } }, status.untracked, nullptr);
+    std::sort(status.untracked.begin(), status.untracked.end());
+    for (auto& path : status.untracked) {
+        path = relative(mPrefix, path);
+    }
+    return true;
+}
+
+namespace {
+struct RefValue
+{
+    std::string hash;
+    // a symbolic ref, resolved once every ref is known
+    std::string target;
+    bool peeled { false };
+};
+} // anonymous namespace
+
+static void readLooseRefs(const std::string& dir, const std::string& name, std::map<std::string, RefValue>& refs)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1)
+        return;
+    std::vector<std::pair<std::string, DirScanner::Type> > entries;
+    DirScanner::forEachEntry(fd, [&entries](const char* entry, DirScanner::Type type) {
+        entries.emplace_back(entry, type);
+    });
+    int e;
+    EINTRWRAP(e, ::close(fd));
+
+    std::string data;
+    for (auto& entry : entries) {
+        const std::string path = dir + "/" + entry.first;
+        const std::string ref = name + "/" + entry.first;
+        if (entry.second == DirScanner::TypeUnknown) {
+            struct stat st;
+            if (::stat(path.c_str(), &st) == -1)
+                continue;
+            entry.second = S_ISDIR(st.st_mode) ? DirScanner::TypeDirectory : DirScanner::TypeFile;
+        }
+        if (entry.second == DirScanner::TypeDirectory) {
+            readLooseRefs(path, ref, refs);
+            continue;
+        }
+        const size_t len = entry.first.size();
+        if (len > 5 && entry.first.compare(len - 5, 5, ".lock") == 0)
+            continue;
+        if (!readFile(path, data))
+            continue;
+        const std::string_view value = trim(data);
+        // a loose ref replaces a packed one, peeled or not
+        RefValue& out = refs[ref];
+        out = RefValue();
+        if (startsWith(value, "ref:"))
+            out.target = trim(value.substr(4));
+        else
+            out.hash = value;
+    }
+}
+
+bool GitRepo::refs(Refs& refs) const
+{
+    std::map<std::string, RefValue> all;
+
+    std::string packed;
+    if (readFile(mCommonDir + "/packed-refs", packed)) {
+        RefValue* last = nullptr;
+        size_t pos = 0;
+        while (pos < packed.size()) {
+            size_t eol = packed.find('\n', pos);
+            if (eol == std::string::npos)
+                eol = packed.size();
+            const std::string_view line = std::string_view(packed).substr(pos, eol - pos);
+            pos = eol + 1;
+            if (line.empty() || line[0] == '#')
+                continue;
+            // the object an annotated tag points to
+            if (line[0] == '^') {
+                if (last)
+                    last->peeled = true;
+                continue;
+            }
+            const size_t space = line.find(' ');
+            if (space == std::string_view::npos) {
+                last = nullptr;
+                continue;
+            }
+            last = &all[std::string(line.substr(space + 1))];
+            last->hash = line.substr(0, space);
+        }
+    }
+
+    readLooseRefs(mCommonDir + "/refs", "refs", all);
+
+    for (const auto& ref : all) {
+        std::string_view name = ref.first;
+        std::vector<Ref>* out;
+        if (startsWith(name, "refs/heads/")) {
+            out = &refs.heads;
+            name.remove_prefix(11);
+        } else if (startsWith(name, "refs/remotes/")) {
+            out = &refs.remotes;
+            name.remove_prefix(13);
+        } else if (startsWith(name, "refs/tags/")) {
+            out = &refs.tags;
+            name.remove_prefix(10);
+        } else {
+            continue;
+        }
+
+        const RefValue* value = &ref.second;
+        for (int depth = 0; value && !value->target.empty() && depth < 5; ++depth) {
+            auto it = all.find(value->target);
+            value = it == all.end() ? nullptr : &it->second;
+        }
+        if (!value || value->hash.empty())
+            continue;
+        out->push_back({ std::string(name), value->hash.substr(0, 7), value->peeled ? "tag" : "commit" });
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+#ifndef GITREPO_H
+#define GITREPO_H
+
+#include "GitIgnore.h"
+#include "GitIndex.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// reads what completion needs straight out of a repository: the index,
+// the worktree against it, and the refs. nothing is cached, nothing is
+// written and no git process is involved.
+// there's no object database access, so index-vs-HEAD changes aren't
+// reported and loose tags are always commits
+class GitRepo
+{
+public:
+    // these match status.TrackedStatus and status.UnmergedStatus in gitutils.ts
+    enum TrackedStatus {
+        WorktreeChanged = 0x100,
+        WorktreeDeleted = 0x200
+    };
+    // from check() when the contents differ but the file may just be
+    // checked out with a filter or an eol conversion. only git can tell,
+    // never reported
+    enum { WorktreeUnknown = 0x10000 };
+    enum UnmergedStatus {
+        BothDeleted,
+        AddedByUs,
+        DeletedByThem,
+        AddedByThem,
+        DeletedByUs,
+        BothAdded,
+        BothModified
+    };
+
+    struct Entry
+    {
+        uint32_t status;
+        std::string path;
+    };
+
+    struct Status
+    {
+        std::vector<Entry> tracked, unmerged;
+        std::vector<std::string> untracked;
+    };
+
+    struct Ref
+    {
+        // without the refs/heads/, refs/remotes/ or refs/tags/ prefix
+        std::string refname;
+        // abbreviated to 7 characters
+        std::string objectname;
+        std::string objecttype;
+    };
+
+    struct Refs
+    {
+        std::vector<Ref> heads, remotes, tags;
+    };
+
+    enum { MaxThreads = 8 };
+
+    // finds the repository path is in, false if there is none
+    bool open(const std::string& path);
+
+    const std::string& worktree() const { return mWorktree; }
+    const std::string& gitDir() const { return mGitDir; }
+    const std::string& commonDir() const { return mCommonDir; }
+    // the directory passed to open() relative to the worktree
+    const std::string& prefix() const { return mPrefix; }
+
+    // paths are relative to the directory passed to open(), like git
+    // status prints them. false if the index can't be used or if
+    // filters or eol conversion leave some files to git
+    bool status(Status& status) const;
+    bool refs(Refs& refs) const;
+    // the checked out branch, or the abbreviated commit if HEAD is detached
+    std::string head() const;
+
+    // what status() is made of, for keeping one up to date. paths
+    // are relative to the worktree here
+
+    struct Directory
+    {
+        // "" or "dir/sub/"
+        std::string path;
+        // including the directory's own .gitignore once it has been walked
+        std::shared_ptr<const GitIgnoreStack> ignores;
+    };
+
+    int loadIndex(GitIndex& index) const;
+    // whether the config or any attributes file, the tracked ones
+    // included, sets up filters or eol conversion
+    bool converts(const GitIndex& index) const;
+    // the worktree status of one index entry, 0 if unchanged
+    uint32_t check(const GitIndex& index, size_t entry, bool converts) const;
+    // check() for every entry, in parallel
+    void checkWorktree(const GitIndex& index, std::vector<uint32_t>& results) const;
+    static void unmerged(const GitIndex& index, std::vector<Entry>& unmerged);
+    // info/exclude and the global excludes
+    std::shared_ptr<const GitIgnoreStack> ignores() const;
+    // the untracked files in and under dirs, unsorted. every directory
+    // walked goes to visited if given
+    void findUntracked(const GitIndex& index, std::vector<Directory> dirs,
+                       std::vector<std::string>& untracked, std::vector<Directory>* visited) const;
+
+    static std::string relative(const std::string& prefix, const std::string& path);
+
+private:
+
+    // the worktree without a trailing slash, where we were opened from
+    // relative to it, "" or "dir/sub/"
+    std::string mWorktree, mPrefix;
+    std::string mGitDir, mCommonDir;
+    std::string mExcludesFile;
+    // converts() as far as the config and the files outside the worktree go
+    bool mConverts { false };
+    size_t mHashSize { 20 };
+    bool mFileMode { true };
+};
+
+#endif
@@ -0,0 +1,304 @@
+#include "HistorySearch.h"
+#include <algorithm>
+#include <unordered_set>
+
+static inline char lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline bool isWordStart(std::string_view line, size_t pos)
+{
+    if (!pos)
+        return true;
+    switch (line[pos - 1]) {
+    case ' ':
+    case '\t':
+    case '/':
+    case '|':
+    case ';':
+    case '&':
+    case '(':
+    case '=':
+    case '-':
+    case '.':
+    case '"':
+    case '\'':
+        return true;
+    default:
+        return false;
+    }
+}
+
+void HistorySearch::clear()
+{
+    mText.clear();
+    mEntries.clear();
+    mMasks.clear();
+    mTrigrams.clear();
+    mLines.clear();
+    mDead = 0;
+}
+
+uint64_t HistorySearch::mask(std::string_view str)
+{
+    uint64_t m = 0;
+    for (char ch : str) {
+        const unsigned char c = static_cast<unsigned char>(lower(ch));
+        if (c >= 'a' && c <= 'z')
+            m |= 1ull << (c - 'a');
+        else if (c >= '0' && c <= '9')
+            m |= 1ull << (26 + c - '0');
+        else
+            m |= 1ull << (36 + c % 28);
+    }
+    return m;
+}
+
+void HistorySearch::trigrams(std::string_view str, std::vector<uint32_t>& out)
+{
+    out.clear();
+    if (str.size() < 3)
+        return;
+    for (size_t i = 0; i + 3 <= str.size(); ++i) {
+        out.push_back((static_cast<uint32_t>(static_cast<unsigned char>(lower(str[i]))) << 16)
+                      | (static_cast<uint32_t>(static_cast<unsigned char>(lower(str[i + 1]))) << 8)
+                      | static_cast<unsigned char>(lower(str[i + 2])));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void HistorySearch::add(std::string_view line)
+{
+    if (line.empty())
+        return;
+
+    auto it = mLines.find(line);
+    if (it != mLines.end()) {
+        if (it->second + 1 == mEntries.size())
+            return;
+        mEntries[it->second].dead = true;
+        ++mDead;
+        mLines.erase(it);
+    }
+
+    const uint32_t id = static_cast<uint32_t>(mEntries.size());
+    const char* data = mText.data();
+    mEntries.push_back({ static_cast<uint32_t>(mText.size()), static_cast<uint32_t>(line.size()), false });
+    mText.append(line.data(), line.size());
+    mMasks.push_back(mask(line));
+    if (mText.data() == data) {
+        mLines.emplace(text(id), id);
+    } else {
+        reindex();
+    }
+
+    std::vector<uint32_t> grams;
+    trigrams(line, grams);
+    for (uint32_t gram : grams) {
+        mTrigrams[gram].push_back(id);
+    }
+
+    if (mDead >= CompactMin && mDead * 2 >= mEntries.size())
+        compact();
+}
+
+void HistorySearch::reindex()
+{
+    mLines.clear();
+    mLines.reserve(mEntries.size() - mDead);
+    for (uint32_t id = 0; id < mEntries.size(); ++id) {
+        if (!mEntries[id].dead)
+            mLines.emplace(text(id), id);
+    }
+}
+
+void HistorySearch::compact()
+{
+    // ids only ever shrink, in order, so the posting lists stay sorted
+    const uint32_t gone = UINT32_MAX;
+    std::vector<uint32_t> ids(mEntries.size(), gone);
+    std::string compacted;
+    compacted.reserve(mText.size());
+    uint32_t next = 0;
+    for (uint32_t id = 0; id < mEntries.size(); ++id) {
+        const Entry entry = mEntries[id];
+        if (entry.dead)
+            continue;
+        ids[id] = next;
+        mEntries[next] = { static_cast<uint32_t>(compacted.size()), entry.length, false };
+        compacted.append(mText, entry.offset, entry.length);
+        mMasks[next] = mMasks[id];
+        ++next;
+    }
+    mEntries.resize(next);
+    mMasks.resize(next);
+    mText = std::move(compacted);
+    mDead = 0;
+
+    for (auto it = mTrigrams.begin(); it != mTrigrams.end(); ) {
+        auto& postings = it->second;
+        size_t out = 0;
+        for (uint32_t id : postings) {
+            if (ids[id] != gone)
+                postings[out++] = ids[id];
+        }
+        if (!out) {
+            it = mTrigrams.erase(it);
+        } else {
+            postings.resize(out);
+            ++it;
+        }
+    }
+
+    reindex();
+}
+
+int HistorySearch::substringClass(std::string_view line, std::string_view query)
+{
+    if (query.size() > line.size())
+        return 0;
+    int best = 0;
+    const size_t last = line.size() - query.size();
+    for (size_t pos = 0; pos <= last; ++pos) {
+        if (lower(line[pos]) != query[0])
+            continue;
+        size_t i = 1;
+        while (i < query.size() && lower(line[pos + i]) == query[i])
+            ++i;
+        if (i < query.size())
+            continue;
+        if (!pos)
+            return 3;
+        best = std::max(best, isWordStart(line, pos) ? 2 : 1);
+        if (best == 2)
+            break;
+    }
+    return best;
+}
+
+size_t HistorySearch::fuzzySpan(std::string_view line, std::string_view query)
+{
+    // match forward greedily, then walk back from where that ended
+    // to find the latest start, fzf does the same
+    size_t q = 0, end = 0;
+    for (size_t i = 0; i < line.size() && q < query.size(); ++i) {
+        if (lower(line[i]) == query[q]) {
+            if (++q == query.size())
+                end = i;
+        }
+    }
+    if (q < query.size())
+        return 0;
+    size_t start = end;
+    q = query.size();
+    for (size_t i = end + 1; i-- > 0; ) {
+        if (lower(line[i]) == query[q - 1]) {
+            start = i;
+            if (!--q)
+                break;
+        }
+    }
+    return end - start + 1;
+}
+
+std::vector<std::string> HistorySearch::search(const std::string& rawQuery, size_t limit) const
+{
+    std::vector<std::string> results;
+    if (!limit)
+        return results;
+
+    std::string query(rawQuery.size(), '\0');
+    std::transform(rawQuery.begin(), rawQuery.end(), query.begin(), lower);
+
+    if (query.empty()) {
+        for (uint32_t id = static_cast<uint32_t>(mEntries.size()); id-- > 0 && results.size() < limit; ) {
+            if (!mEntries[id].dead)
+                results.emplace_back(text(id));
+        }
+        return results;
+    }
+
+    // substring matches, by class, newest first within each
+    std::vector<uint32_t> classes[3];
+    size_t matched = 0;
+    auto consider = [&](uint32_t id) {
+        if (mEntries[id].dead)
+            return true;
+        const int cls = substringClass(text(id), query);
+        if (cls) {
+            classes[3 - cls].push_back(id);
+            ++matched;
+        }
+        return classes[0].size() < limit && matched < limit * Budget;
+    };
+
+    if (query.size() >= 3) {
+        std::vector<uint32_t> grams;
+        trigrams(query, grams);
+        std::vector<const std::vector<uint32_t>*> lists;
+        lists.reserve(grams.size());
+        for (uint32_t gram : grams) {
+            auto it = mTrigrams.find(gram);
+            if (it == mTrigrams.end()) {
+                lists.clear();
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        if (!lists.empty()) {
+            // walk the rarest trigram, look the rest up
+            std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) {
+                return a->size() < b->size();
+            });
+            const auto& rarest = *lists.front();
+            for (size_t i = rarest.size(); i-- > 0; ) {
+                const uint32_t id = rarest[i];
+                bool all = true;
+                for (size_t l = 1; l < lists.size() && all; ++l) {
+                    all = std::binary_search(lists[l]->begin(), lists[l]->end(), id);
+                }
+                if (all && !consider(id))
+                    break;
+            }
+        }
+    } else {
+        for (uint32_t id = static_cast<uint32_t>(mEntries.size()); id-- > 0; ) {
+            if (!consider(id))
+                break;
+        }
+    }
+
+    for (const auto& cls : classes) {
+        for (uint32_t id : cls) {
+            if (results.size() == limit)
+                return results;
+            results.emplace_back(text(id));
+        }
+    }
+
+    // fill up with fuzzy matches, tightest first
+    const size_t wanted = limit - results.size();
+    const uint64_t queryMask = mask(query);
+    std::unordered_set<uint32_t> seen;
+    for (const auto& cls : classes) {
+        seen.insert(cls.begin(), cls.end());
+    }
+    std::vector<std::pair<size_t, uint32_t> > fuzzy;
+    for (uint32_t id = static_cast<uint32_t>(mEntries.size()); id-- > 0 && fuzzy.size() < wanted * Budget; ) {
+        if ((mMasks[id] & queryMask) != queryMask || mEntries[id].dead || seen.count(id))
+            continue;
+        const size_t span = fuzzySpan(text(id), query);
+        if (span)
+            fuzzy.emplace_back(span, id);
+    }
+    // stable, so newer lines still win ties
+    std::stable_sort(fuzzy.begin(), fuzzy.end(), [](const std::pair<size_t, uint32_t>& a, const std::pair<size_t, uint32_t>& b) {
+        return a.first < b.first;
+    });
+    for (size_t i = 0; i < fuzzy.size() && i < wanted; ++i) {
+        results.emplace_back(text(fuzzy[i].second));
+    }
+    return results;
+}
@@ -0,0 +1,69 @@
+#ifndef HISTORYSEARCH_H
+#define HISTORYSEARCH_H
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// case insensitive substring and fuzzy search over the history. a trigram
+// index narrows substring searches down to the lines that can match, a
+// per line character mask does the same for fuzzy ones. entries are only
+// ever appended so posting lists stay sorted, a line added again moves
+// to the front and the old entry is dropped once enough of them pile up.
+// Not thread safe
+class HistorySearch
+{
+public:
+    enum { DefaultLimit = 50 };
+
+    void clear();
+    void add(std::string_view line);
+    size_t size() const { return mEntries.size() - mDead; }
+
+    // best matches first. lines that start with the query rank above
+    // lines where it starts a word, above any other substring match,
+    // above fuzzy matches. within each class newer lines win
+    std::vector<std::string> search(const std::string& query, size_t limit = DefaultLimit) const;
+
+private:
+    enum {
+        // stop looking once this many times the limit have matched,
+        // older lines aren't going to outrank what we have anyway
+        Budget = 16,
+        // compact once at least this many entries, and half of them, are dead
+        CompactMin = 256
+    };
+
+    struct Entry
+    {
+        uint32_t offset;
+        uint32_t length;
+        bool dead;
+    };
+
+    std::string_view text(uint32_t id) const
+    {
+        return std::string_view(mText.data() + mEntries[id].offset, mEntries[id].length);
+    }
+    // 0 if line doesn't contain query, otherwise how good the match is
+    static int substringClass(std::string_view line, std::string_view query);
+    // length of the shortest span holding query as a subsequence, 0 if none
+    static size_t fuzzySpan(std::string_view line, std::string_view query);
+    static uint64_t mask(std::string_view str);
+    static void trigrams(std::string_view str, std::vector<uint32_t>& out);
+    // mLines points into mText, redone whenever that moves
+    void reindex();
+    void compact();
+
+    // all lines back to back
+    std::string mText;
+    std::vector<Entry> mEntries;
+    std::vector<uint64_t> mMasks;
+    std::unordered_map<uint32_t, std::vector<uint32_t> > mTrigrams;
+    std::unordered_map<std::string_view, uint32_t> mLines;
+    size_t mDead { 0 };
+};
+
+#endif
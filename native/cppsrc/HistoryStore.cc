@@ -0,0 +1,250 @@
+#include "HistoryStore.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+static int openLog(const std::string& path)
+{
+    int fd;
+    EINTRWRAP(fd, ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600));
+    return fd;
+}
+
+static void closeFd(int fd)
+{
+    int e;
+    EINTRWRAP(e, ::close(fd));
+}
+
+HistoryStore::~HistoryStore()
+{
+    close();
+}
+
+bool HistoryStore::open(const std::string& path)
+{
+    close();
+
+    mFd = openLog(path);
+    if (mFd == -1)
+        return false;
+    mPath = path;
+
+    if (!lock(LOCK_SH)) {
+        close();
+        return false;
+    }
+    const bool ok = load();
+    flock(mFd, LOCK_UN);
+    if (!ok) {
+        close();
+        return false;
+    }
+
+    if (mDead >= MinDead && mDead > size())
+        compact();
+    return true;
+}
+
+void HistoryStore::close()
+{
+    unload();
+    if (mFd != -1) {
+        closeFd(mFd);
+        mFd = -1;
+    }
+    mPath.clear();
+}
+
+bool HistoryStore::lock(int operation)
+{
+    // another shell may have compacted the file, or readline's
+    // write_history() replaced it. follow the path to the new one
+    for (;;) {
+        int e;
+        EINTRWRAP(e, flock(mFd, operation));
+        if (e == -1)
+            return false;
+
+        struct stat fdst, pathst;
+        if (fstat(mFd, &fdst) == 0 && ::stat(mPath.c_str(), &pathst) == 0
+            && fdst.st_dev == pathst.st_dev && fdst.st_ino == pathst.st_ino) {
+            return true;
+        }
+
+        const int fd = openLog(mPath);
+        if (fd == -1) {
+            flock(mFd, LOCK_UN);
+            return false;
+        }
+        closeFd(mFd);
+        mFd = fd;
+    }
+}
+
+bool HistoryStore::load()
+{
+    struct stat st;
+    if (fstat(mFd, &st) == -1)
+        return false;
+
+    // the file may have shrunk since the fstat, stop where it ends
+    mData.resize(static_cast<size_t>(st.st_size));
+    size_t size = 0;
+    while (size < mData.size()) {
+        ssize_t r;
+        EINTRWRAP(r, ::pread(mFd, &mData[size], mData.size() - size, size));
+        if (r == -1) {
+            std::string().swap(mData);
+            return false;
+        }
+        if (!r)
+            break;
+        size += r;
+    }
+    mData.resize(size);
+
+    const char* const start = mData.data();
+    const char* cur = start;
+    const char* const end = start + size;
+    // a guess at the average line length, good enough to avoid most rehashing
+    mEntries.reserve(size / 24);
+    mLines.reserve(size / 24);
+    while (cur < end) {
+        const char* nl = static_cast<const char*>(memchr(cur, '\n', end - cur));
+        if (!nl)
+            nl = end;
+        if (nl > cur)
+            insert({ static_cast<uint64_t>(cur - start), static_cast<uint32_t>(nl - cur), false, true });
+        cur = nl + 1;
+    }
+    return true;
+}
+
+void HistoryStore::unload()
+{
+    std::string().swap(mData);
+    mEntries.clear();
+    mTail.clear();
+    mLines.clear();
+    mDead = 0;
+}
+
+HistoryStore::AddResult HistoryStore::insert(const Entry& entry)
+{
+    const std::string_view line = text(entry);
+    const uint32_t idx = static_cast<uint32_t>(mEntries.size());
+    mEntries.push_back(entry);
+
+    auto it = mLines.find(line);
+    if (it == mLines.end()) {
+        mLines.emplace(line, idx);
+        return Added;
+    }
+    // the key keeps pointing at the old copy's text, which stays valid
+    mEntries[it->second].live = false;
+    it->second = idx;
+    ++mDead;
+    return Moved;
+}
+
+HistoryStore::AddResult HistoryStore::add(const std::string& line)
+{
+    // entries are lines, an embedded newline would split this one in two
+    if (mFd == -1 || line.empty() || line.find('\n') != std::string::npos)
+        return Failed;
+
+    auto it = mLines.find(line);
+    if (it != mLines.end() && it->second + 1 == mEntries.size())
+        return Unchanged;
+
+    if (!lock(LOCK_SH))
+        return Failed;
+    // O_APPEND, concurrent appends from other shells don't interleave
+    std::string data;
+    data.reserve(line.size() + 1);
+    data += line;
+    data += '\n';
+    ssize_t w;
+    EINTRWRAP(w, ::write(mFd, data.data(), data.size()));
+    flock(mFd, LOCK_UN);
+    if (w != static_cast<ssize_t>(data.size()))
+        return Failed;
+
+    mTail.push_back(line);
+    const AddResult result = insert({ mTail.size() - 1, static_cast<uint32_t>(line.size()), true, true });
+
+    if (mDead >= MinDead && mDead > size())
+        compact();
+    return result;
+}
+
+bool HistoryStore::compact()
+{
+    if (mFd == -1 || !lock(LOCK_EX))
+        return false;
+
+    // start over from what's on disk, that has our lines and everyone else's
+    unload();
+    if (!load()) {
+        flock(mFd, LOCK_UN);
+        return false;
+    }
+
+    const std::string tmp = mPath + ".compact." + std::to_string(getpid());
+    int fd;
+    EINTRWRAP(fd, ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        flock(mFd, LOCK_UN);
+        return false;
+    }
+
+    bool ok = true;
+    std::string buffer;
+    auto flush = [&buffer, &ok, fd]() {
+        size_t written = 0;
+        while (ok && written < buffer.size()) {
+            ssize_t w;
+            EINTRWRAP(w, ::write(fd, buffer.data() + written, buffer.size() - written));
+            if (w <= 0)
+                ok = false;
+            else
+                written += w;
+        }
+        buffer.clear();
+    };
+    forEach([&buffer, &flush](std::string_view line) {
+        buffer.append(line.data(), line.size());
+        buffer += '\n';
+        if (buffer.size() >= 65536)
+            flush();
+    });
+    flush();
+    ok = ok && fsync(fd) == 0;
+    closeFd(fd);
+
+    if (!ok || ::rename(tmp.c_str(), mPath.c_str()) == -1) {
+        ::unlink(tmp.c_str());
+        flock(mFd, LOCK_UN);
+        return false;
+    }
+
+    // anyone waiting on the old file finds the new one in lock()
+    const int old = mFd;
+    mFd = openLog(mPath);
+    flock(old, LOCK_UN);
+    closeFd(old);
+    if (mFd == -1) {
+        unload();
+        return false;
+    }
+
+    unload();
+    flock(mFd, LOCK_SH);
+    const bool loaded = load();
+    flock(mFd, LOCK_UN);
+    return loaded;
+}
@@ -0,0 +1,100 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// the history file as an append-only log. the file is read in one go and
+// indexed by line offsets instead of being parsed, adding a line is one
+// append and a line that was seen before supersedes its older copy. once
+// superseded copies outweigh the live ones the file is rewritten without
+// them. it's a copy rather than a mapping, the file may be truncated
+// under us.
+// still one entry per line so readline can read the file as well.
+// several shells can share the file, flock() keeps appends and compaction
+// apart. Not thread safe
+class HistoryStore
+{
+public:
+    enum AddResult {
+        Added,
+        // the line was in the history already, the older copy is gone
+        Moved,
+        // the line is the latest entry already
+        Unchanged,
+        // not written, the store isn't open, the line can't be stored
+        // (empty or multiline) or the file couldn't be locked or written
+        Failed
+    };
+
+    HistoryStore() = default;
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return mFd != -1; }
+    const std::string& path() const { return mPath; }
+
+    AddResult add(const std::string& line);
+
+    // live entries, oldest first
+    size_t size() const { return mEntries.size() - mDead; }
+    template<typename Func>
+    void forEach(Func&& func) const;
+
+    // rewrites the file with only the live entries, including
+    // whatever other shells have appended in the meantime
+    bool compact();
+
+private:
+    enum { MinDead = 1024 };
+
+    struct Entry
+    {
+        // into mData, or into mTail for lines added since
+        uint64_t offset;
+        uint32_t length;
+        bool tail;
+        bool live;
+    };
+
+    std::string_view text(const Entry& entry) const;
+    AddResult insert(const Entry& entry);
+    bool load();
+    void unload();
+    bool lock(int operation);
+
+    std::string mPath;
+    int mFd { -1 };
+    std::string mData;
+    std::vector<Entry> mEntries;
+    std::deque<std::string> mTail;
+    // keys point into mData or mTail, both outlive the index
+    std::unordered_map<std::string_view, uint32_t> mLines;
+    size_t mDead { 0 };
+};
+
+inline std::string_view HistoryStore::text(const Entry& entry) const
+{
+    if (entry.tail)
+        return std::string_view(mTail[entry.offset]);
+    return std::string_view(mData.data() + entry.offset, entry.length);
+}
+
+template<typename Func>
+void HistoryStore::forEach(Func&& func) const
+{
+    for (const auto& entry : mEntries) {
+        if (entry.live)
+            func(text(entry));
+    }
+}
+
+#endif
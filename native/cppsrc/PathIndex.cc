@@ -0,0 +1,270 @@
+#include "PathIndex.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
+
+enum {
+    // directories we can't watch are checked for changes at most this often
+    CheckInterval = 2000,
+    MaxScanThreads = 8
+};
+
+static uint64_t now()
+{
+    return uv_hrtime() / 1000000;
+}
+
+PathIndex::PathIndex()
+{
+}
+
+PathIndex::~PathIndex()
+{
+    if (mInotify != -1) {
+        int e;
+        EINTRWRAP(e, ::close(mInotify));
+    }
+}
+
+bool PathIndex::setPath(const std::string& path)
+{
+    MutexLocker locker(&mMutex);
+    if (path == mPath && mPathSerial > 0)
+        return false;
+
+#ifdef __linux__
+    if (mInotify == -1) {
+        mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+#endif
+
+    for (const auto& dir : mDirs) {
+#ifdef __linux__
+        if (dir.wd != -1)
+            inotify_rm_watch(mInotify, dir.wd);
+#endif
+    }
+    mDirs.clear();
+
+    size_t start = 0;
+    for (;;) {
+        const size_t colon = path.find(':', start);
+        const std::string dir = path.substr(start, colon == std::string::npos ? std::string::npos : colon - start);
+        // empty entries would make the index depend on the cwd, leave those out
+        if (!dir.empty() && std::find_if(mDirs.begin(), mDirs.end(), [&dir](const Dir& d) { return d.path == dir; }) == mDirs.end()) {
+            mDirs.push_back(Dir());
+            mDirs.back().path = dir;
+            watch(mDirs.back());
+        }
+        if (colon == std::string::npos)
+            break;
+        start = colon + 1;
+    }
+
+    mPath = path;
+    ++mPathSerial;
+    mIndex.clear();
+    ++mGeneration;
+    return true;
+}
+
+void PathIndex::watch(Dir& dir)
+{
+#ifdef __linux__
+    if (mInotify == -1)
+        return;
+    dir.wd = inotify_add_watch(mInotify, dir.path.c_str(),
+                               IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB
+                               | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#else
+    (void)dir;
+#endif
+}
+
+void PathIndex::drainEvents()
+{
+#ifdef __linux__
+    if (mInotify == -1)
+        return;
+    alignas(inotify_event) char buf[8192];
+    for (;;) {
+        ssize_t r;
+        EINTRWRAP(r, ::read(mInotify, buf, sizeof(buf)));
+        if (r <= 0)
+            break;
+        for (char* ptr = buf; ptr < buf + r; ) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + ev->len;
+            for (auto& dir : mDirs) {
+                // a queue overflow means we might have lost anything
+                if (dir.wd == ev->wd || (ev->mask & IN_Q_OVERFLOW)) {
+                    dir.dirty = true;
+                    ++dir.serial;
+                    if (dir.wd == ev->wd && (ev->mask & IN_IGNORED))
+                        dir.wd = -1;
+                }
+            }
+        }
+    }
+#endif
+}
+
+bool PathIndex::refresh()
+{
+    MutexLocker locker(&mMutex);
+    drainEvents();
+
+    bool dirty = false;
+    const uint64_t current = now();
+    for (auto& dir : mDirs) {
+        if (!dir.dirty && dir.wd == -1 && current - dir.lastCheck >= CheckInterval) {
+            dir.lastCheck = current;
+            struct stat st;
+            const int64_t mtime = ::stat(dir.path.c_str(), &st) == 0 ? static_cast<int64_t>(st.st_mtime) : -1;
+            if (mtime != dir.mtime) {
+                dir.dirty = true;
+                ++dir.serial;
+            }
+        }
+        dirty = dirty || dir.dirty;
+    }
+    return dirty;
+}
+
+bool PathIndex::scan(const std::string& path, std::vector<std::string>& executables, int64_t& mtime) const
+{
+    int fd;
+    EINTRWRAP(fd, ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1) {
+        mtime = -1;
+        return false;
+    }
+
+    struct stat st;
+    mtime = fstat(fd, &st) == 0 ? static_cast<int64_t>(st.st_mtime) : -1;
+
+    DirScanner::forEachEntry(fd, [this, fd, &executables](const char* name, DirScanner::Type type) {
+        // only regular files count, symlinks and unknowns need a stat to tell
+        if (type != DirScanner::TypeFile && type != DirScanner::TypeSymlink && type != DirScanner::TypeUnknown)
+            return;
+        struct stat st;
+        if (fstatat(fd, name, &st, 0) == 0 && mPermissions.isExecutable(st))
+            executables.push_back(name);
+    });
+
+    int e;
+    EINTRWRAP(e, ::close(fd));
+    return true;
+}
+
+void PathIndex::rebuild()
+{
+    struct Job
+    {
+        size_t dir;
+        std::string path;
+        uint64_t serial;
+        std::vector<std::string> executables;
+        int64_t mtime;
+    };
+    std::vector<Job> jobs;
+    uint64_t pathSerial;
+
+    {
+        MutexLocker locker(&mMutex);
+        pathSerial = mPathSerial;
+        for (size_t i = 0; i < mDirs.size(); ++i) {
+            Dir& dir = mDirs[i];
+            if (!dir.dirty)
+                continue;
+            // watch before scanning so that we don't miss anything in between
+            if (dir.wd == -1)
+                watch(dir);
+            jobs.push_back({ i, dir.path, dir.serial, {}, -1 });
+        }
+    }
+
+    if (jobs.empty())
+        return;
+
+    std::atomic<size_t> next { 0 };
+    auto work = [this, &jobs, &next]() {
+        for (;;) {
+            const size_t idx = next.fetch_add(1);
+            if (idx >= jobs.size())
+                break;
+            scan(jobs[idx].path, jobs[idx].executables, jobs[idx].mtime);
+        }
+    };
+    // network filesystems are slow on every entry, not just the first
+    const size_t threads = std::min<size_t>(jobs.size(), MaxScanThreads);
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    MutexLocker locker(&mMutex);
+    if (pathSerial != mPathSerial)
+        return;
+    const uint64_t current = now();
+    for (auto& job : jobs) {
+        Dir& dir = mDirs[job.dir];
+        dir.executables = std::move(job.executables);
+        dir.mtime = job.mtime;
+        dir.lastCheck = current;
+        if (dir.serial == job.serial)
+            dir.dirty = false;
+    }
+    merge();
+}
+
+void PathIndex::merge()
+{
+    mIndex.clear();
+    for (const auto& dir : mDirs) {
+        for (const auto& name : dir.executables) {
+            // the first directory in PATH wins
+            mIndex.emplace(name, dir.path + "/" + name);
+        }
+    }
+    ++mGeneration;
+}
+
+bool PathIndex::lookup(const std::string& name, std::string& path)
+{
+    MutexLocker locker(&mMutex);
+    auto it = mIndex.find(name);
+    if (it == mIndex.end())
+        return false;
+    path = it->second;
+    return true;
+}
+
+std::vector<std::string> PathIndex::names()
+{
+    MutexLocker locker(&mMutex);
+    std::vector<std::string> ret;
+    ret.reserve(mIndex.size());
+    for (const auto& entry : mIndex) {
+        ret.push_back(entry.first);
+    }
+    return ret;
+}
+
+uint64_t PathIndex::generation()
+{
+    MutexLocker locker(&mMutex);
+    return mGeneration;
+}
@@ -0,0 +1,67 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include "DirScanner.h"
+#include "utils.h"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+// command name -> executable for every directory in PATH. Directories
+// are scanned in parallel and rescanned when inotify (or on other
+// platforms, their mtime) says they changed. Thread safe
+class PathIndex
+{
+public:
+    PathIndex();
+    ~PathIndex();
+
+    // switches to a new PATH, returns true if it differs from the current one
+    bool setPath(const std::string& path);
+
+    // picks up changes since the last call, returns true if
+    // any directory needs to be rescanned
+    bool refresh();
+
+    // rescans all dirty directories and rebuilds the index
+    void rebuild();
+
+    bool lookup(const std::string& name, std::string& path);
+    std::vector<std::string> names();
+
+    // bumped whenever the set of names changes
+    uint64_t generation();
+
+private:
+    struct Dir
+    {
+        std::string path;
+        int wd { -1 };
+        bool dirty { true };
+        // bumped on every invalidation so that a scan that raced
+        // with a change doesn't clear the dirty flag
+        uint64_t serial { 0 };
+        uint64_t lastCheck { 0 };
+        int64_t mtime { -1 };
+        std::vector<std::string> executables;
+    };
+
+    bool scan(const std::string& dir, std::vector<std::string>& executables, int64_t& mtime) const;
+    void watch(Dir& dir);
+    void drainEvents();
+    void merge();
+
+    Mutex mMutex;
+    std::string mPath;
+    uint64_t mPathSerial { 0 };
+    std::vector<Dir> mDirs;
+    std::unordered_map<std::string, std::string> mIndex;
+    uint64_t mGeneration { 0 };
+    int mInotify { -1 };
+
+    DirScanner::Permissions mPermissions;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "Poller.h"
+#include "utils.h"
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+enum { MaxEvents = 256 };
+
+Poller::Poller()
+    : mFd(-1)
+{
+}
+
+Poller::~Poller()
+{
+    close();
+}
+
+bool Poller::open()
+{
+    if (mFd != -1)
+        return true;
+#ifdef __linux__
+    mFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    mFd = kqueue();
+    if (mFd != -1) {
+        fcntl(mFd, F_SETFD, fcntl(mFd, F_GETFD) | FD_CLOEXEC);
+    }
+#endif
+    return mFd != -1;
+}
+
+void Poller::close()
+{
+    if (mFd == -1)
+        return;
+    int e;
+    EINTRWRAP(e, ::close(mFd));
+    mFd = -1;
+}
+
+bool Poller::add(int fd, uint32_t events, void* data)
+{
+#ifdef __linux__
+    epoll_event ev;
+    ev.events = 0;
+    if (events & Read)
+        ev.events |= EPOLLIN;
+    if (events & Write)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = data;
+    if (epoll_ctl(mFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        if (errno != EEXIST)
+            return false;
+        return epoll_ctl(mFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+    return true;
+#else
+    struct kevent evs[2];
+    int n = 0;
+    if (events & Read)
+        EV_SET(&evs[n++], fd, EVFILT_READ, EV_ADD, 0, 0, data);
+    if (events & Write)
+        EV_SET(&evs[n++], fd, EVFILT_WRITE, EV_ADD, 0, 0, data);
+    return kevent(mFd, evs, n, nullptr, 0, nullptr) == 0;
+#endif
+}
+
+void Poller::remove(int fd, uint32_t events)
+{
+#ifdef __linux__
+    (void)events;
+    epoll_ctl(mFd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+    // kqueue reports ENOENT for filters that were never added,
+    // issue them one by one so that one miss doesn't drop the other
+    struct kevent ev;
+    if (events & Read) {
+        EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        kevent(mFd, &ev, 1, nullptr, 0, nullptr);
+    }
+    if (events & Write) {
+        EV_SET(&ev, fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        kevent(mFd, &ev, 1, nullptr, 0, nullptr);
+    }
+#endif
+}
+
+int Poller::wait(Event* events, int max, int timeout)
+{
+    if (max > MaxEvents)
+        max = MaxEvents;
+    int n;
+#ifdef __linux__
+    epoll_event evs[MaxEvents];
+    EINTRWRAP(n, epoll_wait(mFd, evs, max, timeout));
+    for (int i = 0; i < n; ++i) {
+        events[i].data = evs[i].data.ptr;
+        events[i].events = 0;
+        // hangups and errors are reported as readiness so that the
+        // following read() or write() gets to see them
+        if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            events[i].events |= Read;
+        if (evs[i].events & (EPOLLOUT | EPOLLERR))
+            events[i].events |= Write;
+    }
+#else
+    struct kevent evs[MaxEvents];
+    timespec ts;
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000;
+    }
+    EINTRWRAP(n, kevent(mFd, nullptr, 0, evs, max, timeout >= 0 ? &ts : nullptr));
+    for (int i = 0; i < n; ++i) {
+        events[i].data = evs[i].udata;
+        events[i].events = evs[i].filter == EVFILT_WRITE ? Write : Read;
+    }
+#endif
+    return n;
+}
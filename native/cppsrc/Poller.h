@@ -0,0 +1,40 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdint.h>
+
+// persistent fd readiness set, epoll on linux and kqueue elsewhere.
+// fds are registered once and stay registered until removed, so
+// waiting costs O(ready fds) rather than O(watched fds)
+class Poller
+{
+public:
+    Poller();
+    ~Poller();
+
+    enum { Read = 0x1, Write = 0x2 };
+
+    struct Event
+    {
+        void* data;
+        uint32_t events;
+    };
+
+    bool open();
+    void close();
+    bool isOpen() const { return mFd != -1; }
+
+    // data is handed back as-is in Event::data
+    bool add(int fd, uint32_t events, void* data);
+    // fds must be removed before they're closed, children may hold
+    // on to a dup of the same file description
+    void remove(int fd, uint32_t events);
+
+    // returns the number of events filled in, -1 on error
+    int wait(Event* events, int max, int timeout = -1);
+
+private:
+    int mFd;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "QuoteTable.h"
+
+void QuoteTable::build(const char* line, int length)
+{
+    enum Quote {
+        Normal,
+        Double,
+        Single
+    };
+    Quote quote = Normal;
+    bool escaped = false;
+
+    mLine = line;
+    mLength = length;
+    mQuoted.resize(length + 1);
+
+    for (int i = 0; i <= length;) {
+        const bool wasEscaped = escaped;
+        switch (line[i]) {
+        case '\\':
+            escaped = !escaped;
+            break;
+        case '"':
+            if (!escaped) {
+                if (quote == Normal)
+                    quote = Double;
+                else if (quote == Double)
+                    quote = Normal;
+            }
+            escaped = false;
+            break;
+        case '\'':
+            if (!escaped) {
+                if (quote == Normal)
+                    quote = Single;
+                else if (quote == Single)
+                    quote = Normal;
+            }
+            escaped = false;
+            break;
+        default:
+            escaped = false;
+            break;
+        }
+
+        // an opening quote or a backslash counts as quoted, a closing quote doesn't
+        const uint8_t q = wasEscaped || escaped || quote != Normal;
+        // continuation bytes are 10xxxxxx
+        do {
+            mQuoted[i++] = q;
+        } while (i < length && (static_cast<unsigned char>(line[i]) & 0xc0) == 0x80);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef QUOTETABLE_H
+#define QUOTETABLE_H
+
+#include <stdint.h>
+#include <vector>
+
+// whether each character of a line is quoted or escaped, the way the
+// lexer in src/parser sees it. built in one pass so readline's word
+// splitting can ask about any number of positions. multibyte utf-8
+// characters share the state of their first byte
+class QuoteTable
+{
+public:
+    // line[length] is part of the table too
+    void build(const char* line, int length);
+    void clear() { mLine = nullptr; }
+
+    bool valid(const char* line, int length) const { return mLine && line == mLine && length == mLength; }
+    bool quoted(int idx) const { return idx >= 0 && idx <= mLength && mQuoted[idx]; }
+
+private:
+    const char* mLine { nullptr };
+    int mLength { 0 };
+    std::vector<uint8_t> mQuoted;
+};
+
+#endif
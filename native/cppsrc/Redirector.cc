@@ -73,6 +73,36 @@ void Redirector::writeStderr(const char* data, int len)
     EINTRWRAP(w, write(mStderr.real, data, len));
 }
 
+static void writeAll(int fd, struct iovec* iov, int count)
+{
+    while (count > 0) {
+        ssize_t w;
+        EINTRWRAP(w, ::writev(fd, iov, count));
+        if (w == -1)
+            return;
+        // skip past what made it, partial writes leave the rest of an iovec
+        while (count > 0 && static_cast<size_t>(w) >= iov->iov_len) {
+            w -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + w;
+            iov->iov_len -= w;
+        }
+    }
+}
+
+void Redirector::writeStdout(struct iovec* iov, int count)
+{
+    writeAll(mStdout.real, iov, count);
+}
+
+void Redirector::writeStderr(struct iovec* iov, int count)
+{
+    writeAll(mStderr.real, iov, count);
+}
+
 void Redirector::pause()
 {
     if (mPaused)
@@ -2,6 +2,7 @@
 #define REDIRECTOR_H
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 class Redirector
 {
@@ -20,6 +21,9 @@ public:
 
     void writeStdout(const char* data, int len = -1);
     void writeStderr(const char* data, int len = -1);
+    // all of iov in as few writes as the fd takes, iov is consumed
+    void writeStdout(struct iovec* iov, int count);
+    void writeStderr(struct iovec* iov, int count);
 
     void quiet();
     void pause();
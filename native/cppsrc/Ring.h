@@ -0,0 +1,103 @@
+#ifndef RING_H
+#define RING_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+// bounded lock-free ring, any number of producers and a single consumer.
+// each cell carries a sequence number that tells producers and the
+// consumer whose turn it is, so neither side ever takes a lock.
+// T needs to be default constructible and move assignable
+template<typename T>
+class Ring
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit Ring(size_t capacity = 256);
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // returns false and leaves t alone if the ring is full
+    template<typename U>
+    bool push(U&& t);
+
+    // consumer only
+    bool pop(T& t);
+
+    size_t capacity() const { return mMask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    enum { CacheLine = 64 };
+
+    std::unique_ptr<Cell[]> mCells;
+    size_t mMask;
+    alignas(CacheLine) std::atomic<size_t> mTail;
+    alignas(CacheLine) std::atomic<size_t> mHead;
+};
+
+template<typename T>
+Ring<T>::Ring(size_t capacity)
+    : mTail(0), mHead(0)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    mMask = size - 1;
+    mCells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+template<typename U>
+bool Ring<T>::push(U&& t)
+{
+    Cell* cell;
+    size_t pos = mTail.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &mCells[pos & mMask];
+        const size_t seq = cell->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            // the cell is free, try to claim it
+            if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // the consumer hasn't gotten here yet
+            return false;
+        } else {
+            // another producer beat us to it
+            pos = mTail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->data = std::forward<U>(t);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool Ring<T>::pop(T& t)
+{
+    const size_t pos = mHead.load(std::memory_order_relaxed);
+    Cell* cell = &mCells[pos & mMask];
+    const size_t seq = cell->sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+        return false;
+    t = std::move(cell->data);
+    // hand the cell back to producers for the next lap
+    cell->sequence.store(pos + mMask + 1, std::memory_order_release);
+    mHead.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "Sha1.h"
+#include <string.h>
+
+static inline uint32_t rol(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+Sha1::Sha1()
+    : mState { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 }
+{
+}
+
+void Sha1::block(const uint8_t* data)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) | (static_cast<uint32_t>(data[i * 4 + 1]) << 16)
+            | (static_cast<uint32_t>(data[i * 4 + 2]) << 8) | data[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = mState[0], b = mState[1], c = mState[2], d = mState[3], e = mState[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        const uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    mState[0] += a;
+    mState[1] += b;
+    mState[2] += c;
+    mState[3] += d;
+    mState[4] += e;
+}
+
+void Sha1::update(const void* data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    mLength += size;
+    if (mUsed) {
+        const size_t n = size < 64 - mUsed ? size : 64 - mUsed;
+        memcpy(mBuffer + mUsed, bytes, n);
+        mUsed += n;
+        bytes += n;
+        size -= n;
+        if (mUsed < 64)
+            return;
+        block(mBuffer);
+        mUsed = 0;
+    }
+    while (size >= 64) {
+        block(bytes);
+        bytes += 64;
+        size -= 64;
+    }
+    memcpy(mBuffer, bytes, size);
+    mUsed = size;
+}
+
+void Sha1::final(uint8_t digest[DigestSize])
+{
+    const uint64_t bits = mLength * 8;
+    const uint8_t pad = 0x80;
+    update(&pad, 1);
+    const uint8_t zero[64] = {};
+    update(zero, mUsed <= 56 ? 56 - mUsed : 120 - mUsed);
+    uint8_t len[8];
+    for (int i = 0; i < 8; ++i) {
+        len[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    update(len, 8);
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(mState[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(mState[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(mState[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(mState[i]);
+    }
+}
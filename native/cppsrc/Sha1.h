@@ -0,0 +1,28 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// plain sha-1, enough to hash git blobs. not for anything that needs
+// collision resistance
+class Sha1
+{
+public:
+    enum { DigestSize = 20 };
+
+    Sha1();
+
+    void update(const void* data, size_t size);
+    void final(uint8_t digest[DigestSize]);
+
+private:
+    void block(const uint8_t* data);
+
+    uint32_t mState[5];
+    uint64_t mLength { 0 };
+    uint8_t mBuffer[64];
+    size_t mUsed { 0 };
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// counters cheap enough for hot paths, everything is relaxed. whoever
+// reads them gets each value as it was at some point, not a snapshot
+
+class Counter
+{
+public:
+    void add(uint64_t n = 1) { mValue.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return mValue.load(std::memory_order_relaxed); }
+    void reset() { mValue.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> mValue { 0 };
+};
+
+// the largest value seen
+class Peak
+{
+public:
+    void update(uint64_t value)
+    {
+        uint64_t cur = mValue.load(std::memory_order_relaxed);
+        while (cur < value && !mValue.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            ;
+    }
+    uint64_t value() const { return mValue.load(std::memory_order_relaxed); }
+    void reset() { mValue.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> mValue { 0 };
+};
+
+// power of two buckets, bucket n holds values in [2^(n-1), 2^n)
+class Histogram
+{
+public:
+    enum { Buckets = 32 };
+
+    void add(uint64_t value)
+    {
+        size_t bucket = value ? 64 - __builtin_clzll(value) : 0;
+        if (bucket >= Buckets)
+            bucket = Buckets - 1;
+        mBuckets[bucket].add();
+        mCount.add();
+        mSum.add(value);
+    }
+
+    uint64_t count() const { return mCount.value(); }
+    uint64_t sum() const { return mSum.value(); }
+    uint64_t bucket(size_t idx) const { return mBuckets[idx].value(); }
+    // the upper bound of the bucket holding the given fraction of values
+    uint64_t percentile(double p) const
+    {
+        const uint64_t total = count();
+        if (!total)
+            return 0;
+        const uint64_t wanted = static_cast<uint64_t>(total * p);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < Buckets; ++i) {
+            seen += bucket(i);
+            if (seen > wanted)
+                return upperBound(i);
+        }
+        return upperBound(Buckets - 1);
+    }
+    static uint64_t upperBound(size_t idx) { return idx ? (1ull << idx) - 1 : 0; }
+
+    void reset()
+    {
+        for (auto& b : mBuckets) {
+            b.reset();
+        }
+        mCount.reset();
+        mSum.reset();
+    }
+
+private:
+    Counter mBuckets[Buckets];
+    Counter mCount, mSum;
+};
+
+#endif
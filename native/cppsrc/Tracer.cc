@@ -0,0 +1,50 @@
+#include "Tracer.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+void Tracer::setEnabled(bool enabled, size_t capacity)
+{
+    mEnabled = enabled;
+    if (!enabled)
+        return;
+    mEvents.clear();
+    mEvents.resize(capacity ? capacity : 1);
+    mNext = 0;
+    mWrapped = false;
+}
+
+void Tracer::record(const char* name, uint64_t start, uint64_t end, const char* argName, int64_t arg)
+{
+    if (!mEnabled)
+        return;
+    mEvents[mNext] = { name, argName, start, end - start, arg };
+    if (++mNext == mEvents.size()) {
+        mNext = 0;
+        mWrapped = true;
+    }
+}
+
+std::string Tracer::chromeTrace() const
+{
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    const size_t count = mWrapped ? mEvents.size() : mNext;
+    const size_t first = mWrapped ? mNext : 0;
+    char buf[256];
+    for (size_t i = 0; i < count; ++i) {
+        const Event& ev = mEvents[(first + i) % mEvents.size()];
+        // microseconds with the nanoseconds as fraction, chrome wants ts/dur in us
+        int n = snprintf(buf, sizeof(buf),
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u",
+                         i ? "," : "", ev.name,
+                         ev.start / 1000, static_cast<unsigned>(ev.start % 1000),
+                         ev.duration / 1000, static_cast<unsigned>(ev.duration % 1000));
+        out.append(buf, n);
+        if (ev.argName) {
+            n = snprintf(buf, sizeof(buf), ",\"args\":{\"%s\":%" PRId64 "}", ev.argName, ev.arg);
+            out.append(buf, n);
+        }
+        out += '}';
+    }
+    out += "]}";
+    return out;
+}
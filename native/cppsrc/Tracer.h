@@ -0,0 +1,70 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <uv.h>
+
+// a ring of timed spans, oldest overwritten first. meant to be used
+// from a single thread, names have to be string literals
+class Tracer
+{
+public:
+    enum { DefaultCapacity = 65536 };
+
+    bool enabled() const { return mEnabled; }
+    // enabling clears whatever was recorded before
+    void setEnabled(bool enabled, size_t capacity = DefaultCapacity);
+
+    // times from uv_hrtime()
+    void record(const char* name, uint64_t start, uint64_t end, const char* argName = nullptr, int64_t arg = 0);
+
+    // the recorded spans in chrome's trace event format, for chrome://tracing or perfetto
+    std::string chromeTrace() const;
+
+private:
+    struct Event
+    {
+        const char* name;
+        const char* argName;
+        uint64_t start;
+        uint64_t duration;
+        int64_t arg;
+    };
+
+    std::vector<Event> mEvents;
+    size_t mNext { 0 };
+    bool mWrapped { false };
+    bool mEnabled { false };
+};
+
+// records a span from construction to destruction if tracing is on
+class TraceScope
+{
+public:
+    TraceScope(Tracer& tracer, const char* name, const char* argName = nullptr)
+        : mTracer(tracer), mName(name), mArgName(argName), mStart(tracer.enabled() ? uv_hrtime() : 0)
+    {
+    }
+    ~TraceScope()
+    {
+        if (mStart)
+            mTracer.record(mName, mStart, uv_hrtime(), mArgName, mArg);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void setArg(int64_t arg) { mArg = arg; }
+
+private:
+    Tracer& mTracer;
+    const char* mName;
+    const char* mArgName;
+    uint64_t mStart;
+    int64_t mArg { 0 };
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "GitCache.h"
+#include "GitRepo.h"
+#include <memory>
+#include <string>
+#include <napi.h>
+#include <uv.h>
+
+struct GitWork
+{
+    enum Type { Toplevel, Status, Refs };
+
+    GitWork(Type t, Napi::Promise::Deferred&& d)
+        : type(t), deferred(std::move(d))
+    {
+    }
+    uv_work_t req;
+    Type type;
+    Napi::Promise::Deferred deferred;
+    std::string path;
+    // false resolves with undefined, the caller falls back to git itself
+    bool ok { false };
+    GitRepo repo;
+    GitRepo::Status status;
+    GitRepo::Refs refs;
+};
+
+static GitCache gitCache;
+
+static Napi::Array toArray(napi_env env, const std::vector<GitRepo::Entry>& entries, const std::string& prefix)
+{
+    Napi::Array array = Napi::Array::New(env, entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("status", Napi::Number::New(env, entries[i].status));
+        obj.Set("path", Napi::String::New(env, GitRepo::relative(prefix, entries[i].path)));
+        array.Set(i, obj);
+    }
+    return array;
+}
+
+static Napi::Array toArray(napi_env env, const std::vector<GitRepo::Ref>& refs)
+{
+    Napi::Array array = Napi::Array::New(env, refs.size());
+    for (size_t i = 0; i < refs.size(); ++i) {
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("refname", Napi::String::New(env, refs[i].refname));
+        obj.Set("objectname", Napi::String::New(env, refs[i].objectname));
+        obj.Set("objecttype", Napi::String::New(env, refs[i].objecttype));
+        array.Set(i, obj);
+    }
+    return array;
+}
+
+// same shape as status.Status, empty categories are left out. paths
+// are made relative to prefix
+static Napi::Object statusValue(napi_env env, const GitRepo::Status& status, const std::string& prefix)
+{
+    Napi::Object obj = Napi::Object::New(env);
+    if (!status.tracked.empty())
+        obj.Set("tracked", toArray(env, status.tracked, prefix));
+    if (!status.unmerged.empty())
+        obj.Set("unmerged", toArray(env, status.unmerged, prefix));
+    if (!status.untracked.empty()) {
+        Napi::Array untracked = Napi::Array::New(env, status.untracked.size());
+        for (size_t i = 0; i < status.untracked.size(); ++i) {
+            untracked.Set(i, Napi::String::New(env, GitRepo::relative(prefix, status.untracked[i])));
+        }
+        obj.Set("untracked", untracked);
+    }
+    return obj;
+}
+
+static Napi::Object refsValue(napi_env env, const GitRepo::Refs& refs)
+{
+    Napi::Object obj = Napi::Object::New(env);
+    if (!refs.heads.empty())
+        obj.Set("heads", toArray(env, refs.heads));
+    if (!refs.remotes.empty())
+        obj.Set("remotes", toArray(env, refs.remotes));
+    if (!refs.tags.empty())
+        obj.Set("tags", toArray(env, refs.tags));
+    return obj;
+}
+
+static Napi::Value result(napi_env env, const GitWork& work)
+{
+    switch (work.type) {
+    case GitWork::Toplevel:
+        return Napi::String::New(env, work.repo.worktree());
+    case GitWork::Status:
+        // already relative to where we were asked from
+        return statusValue(env, work.status, std::string());
+    case GitWork::Refs:
+        return refsValue(env, work.refs);
+    }
+    return Napi::Env(env).Undefined();
+}
+
+static Napi::Value queue(const Napi::CallbackInfo& info, GitWork::Type type)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+
+    auto work = std::make_unique<GitWork>(type, Napi::Promise::Deferred::New(env));
+    work->path = info[0].As<Napi::String>().Utf8Value();
+
+    auto promise = work->deferred.Promise();
+    work->req.data = work.get();
+    uv_queue_work(uv_default_loop(), &work->req,
+                  [](uv_work_t* req) {
+                      auto work = static_cast<GitWork*>(req->data);
+                      if (!work->repo.open(work->path))
+                          return;
+                      switch (work->type) {
+                      case GitWork::Toplevel:
+                          work->ok = true;
+                          break;
+                      case GitWork::Status:
+                          work->ok = work->repo.status(work->status);
+                          break;
+                      case GitWork::Refs:
+                          work->ok = work->repo.refs(work->refs);
+                          break;
+                      }
+                  },
+                  [](uv_work_t* req, int) {
+                      std::unique_ptr<GitWork> work(static_cast<GitWork*>(req->data));
+                      auto env = work->deferred.Env();
+                      Napi::HandleScope scope(env);
+                      if (!work->ok) {
+                          work->deferred.Resolve(env.Undefined());
+                          return;
+                      }
+                      work->deferred.Resolve(result(env, *work));
+                  });
+    work.release();
+    return promise;
+}
+
+Napi::Value Toplevel(const Napi::CallbackInfo& info)
+{
+    return queue(info, GitWork::Toplevel);
+}
+
+Napi::Value Status(const Napi::CallbackInfo& info)
+{
+    return queue(info, GitWork::Status);
+}
+
+Napi::Value Refs(const Napi::CallbackInfo& info)
+{
+    return queue(info, GitWork::Refs);
+}
+
+static std::shared_ptr<const GitCache::Snapshot> cachedSnapshot(const Napi::CallbackInfo& info, std::string& prefix)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+
+    return gitCache.snapshot(info[0].As<Napi::String>().Utf8Value(), prefix);
+}
+
+Napi::Value Generation(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    std::string prefix;
+    auto snapshot = cachedSnapshot(info, prefix);
+    if (!snapshot)
+        return env.Undefined();
+    return Napi::Number::New(env, static_cast<double>(snapshot->generation));
+}
+
+Napi::Value Snapshot(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    std::string prefix;
+    auto snapshot = cachedSnapshot(info, prefix);
+    if (!snapshot)
+        return env.Undefined();
+
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("generation", Napi::Number::New(env, static_cast<double>(snapshot->generation)));
+    obj.Set("toplevel", Napi::String::New(env, snapshot->worktree));
+    obj.Set("head", Napi::String::New(env, snapshot->head));
+    obj.Set("status", statusValue(env, snapshot->status, prefix));
+    obj.Set("refs", refsValue(env, snapshot->refs));
+    return obj;
+}
+
+Napi::Object Setup(Napi::Env env, Napi::Object exports)
+{
+    napi_add_env_cleanup_hook(env, [](void*) {
+        gitCache.stop();
+    }, nullptr);
+
+    exports.Set("toplevel", Napi::Function::New(env, Toplevel));
+    exports.Set("status", Napi::Function::New(env, Status));
+    exports.Set("refs", Napi::Function::New(env, Refs));
+    exports.Set("generation", Napi::Function::New(env, Generation));
+    exports.Set("snapshot", Napi::Function::New(env, Snapshot));
+    return exports;
+}
+
+NODE_API_MODULE(git_native, Setup)
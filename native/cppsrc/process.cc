@@ -1,3 +1,8 @@
+#include "BufferPool.h"
+#include "DirCache.h"
+#include "PathIndex.h"
+#include "Poller.h"
+#include "Stats.h"
 #include "utils.h"
 #include <mutex>
 #include <thread>
@@ -5,12 +10,19 @@
 #include <deque>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 #include <napi.h>
 #include <uv.h>
 #include <grp.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <spawn.h>
+#include <string.h>
 #include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <sys/uio.h>
+#include <limits.h>
 #include <termios.h>
 
 struct AsyncFunction
@@ -23,6 +35,29 @@ struct AsyncFunction
     Napi::AsyncContext ctx;
 };
 
+struct BufferEmitter;
+struct Process;
+
+// chunks read from child processes live in pooled buffers
+// all the way until js is done with them
+static BufferPool bufferPool;
+
+// what the reader thread has been up to, see Stats()
+static struct {
+    // poller.wait() returning, the events it returned and how often it timed out
+    Counter wakeups, events, timeouts;
+    Counter reads, bytesRead, throttled;
+    Counter writes, bytesWritten, writesBlocked;
+    // uv_async_send() calls against the async callbacks they turned into
+    Counter asyncSends, asyncCallbacks;
+    Counter sigchlds, reaps, stops;
+    Counter launches, launchFailures;
+    // chunks drained from a single emitter, and emitters, per async callback
+    Peak queueDepth, pendingEmitters;
+    // microseconds spent in fork/posix_spawn and setting up the process
+    Histogram launchLatency;
+} counters;
+
 struct ProcessOptions
 {
     bool redirectStdin;
@@ -31,6 +66,8 @@ struct ProcessOptions
     bool interactive;
     bool foreground;
     int pgid, originalStdout, originalStderr;
+    // the stdout or stderr of another process to use as our stdin
+    std::shared_ptr<BufferEmitter> stdinFrom;
 };
 
 // this is kept in sync with index.d.ts
@@ -57,6 +94,25 @@ struct BufferEmitter : public std::enable_shared_from_this<BufferEmitter>
     Queue<Data> queue;
     std::vector<Data> pending;
 
+    // the fd is only polled once someone claims it, either by
+    // listening or by handing it to another process as its stdin.
+    // set on the js thread, the reader thread looks at it when the
+    // process exits
+    std::weak_ptr<Process> process;
+    int stream { 0 };
+    std::atomic<bool> claimed { false };
+    // already in reader.pendingemitters, protected by reader.mutex
+    bool scheduled { false };
+
+    // bytes read since js last asked for more. Once this goes past
+    // highWaterMark the fd is taken out of the poller until js resumes
+    // us, the child then blocks on a full pipe instead of us buffering
+    std::atomic<size_t> outstanding { 0 };
+    size_t highWaterMark { 256 * 1024 };
+    // protected by reader.mutex
+    bool throttled { false };
+    Counter bytesRead;
+
     struct Async
     {
         Async(Napi::FunctionReference&& f, Napi::AsyncContext&& c)
@@ -68,17 +124,37 @@ struct BufferEmitter : public std::enable_shared_from_this<BufferEmitter>
     };
     std::shared_ptr<Async> async;
 
+    ~BufferEmitter();
+
+    // data must come from bufferPool
     static Napi::Value makeBuffer(const Napi::Env& env, char* str, size_t size);
 
+    enum DeliverMode { DeliverCall, DeliverMakeCallback };
+    // hands chunks to the listener. mostly full chunks are handed over as
+    // they are, runs of small ones are merged into one Buffer of up to
+    // reader.batchBytes
+    void deliver(const Napi::Env& env, std::vector<Data>& chunks, DeliverMode mode);
+
     void emit(char* data, size_t size);
 };
 
+inline BufferEmitter::~BufferEmitter()
+{
+    Data data;
+    while (queue.pop(data)) {
+        bufferPool.release(data.data);
+    }
+    for (const auto& d : pending) {
+        bufferPool.release(d.data);
+    }
+}
+
 inline Napi::Value BufferEmitter::makeBuffer(const Napi::Env& env, char* str, size_t size)
 {
-    return Napi::Buffer<char>::New(env, str, size, [](const Napi::Env&, char* d) { free(d); });
+    return Napi::Buffer<char>::New(env, str, size, [](const Napi::Env&, char* d) { bufferPool.release(d); });
 }
 
-struct Process
+struct Process : public std::enable_shared_from_this<Process>
 {
     std::string cmd;
     std::vector<std::string> args;
@@ -91,6 +167,11 @@ struct Process
     pid_t pid, pgid;
     int status { -1 };
     bool running { false };
+    // exec failed in the child, reported through runpipe
+    bool failed { false };
+    // reader thread only
+    bool exitReported { false };
+    int runpipe { -1 };
     bool needsWrite { false };
     bool pendingClose { false };
     bool tmodesSaved { false };
@@ -98,15 +179,43 @@ struct Process
 
     std::unique_ptr<AsyncFunction> callback;
 
+    // handed to the poller as event data so that we can get
+    // from a ready fd back to its process
+    enum Stream { StreamStdin, StreamStdout, StreamStderr, StreamExec, StreamExit };
+    struct Watch
+    {
+        Process* process;
+        Stream stream;
+    };
+    Watch watches[5] { { this, StreamStdin }, { this, StreamStdout }, { this, StreamStderr }, { this, StreamExec }, { this, StreamExit } };
+    // readable once the process exits, -1 if pidfds aren't supported
+    int pidfd { -1 };
+
     struct Writer
     {
         std::weak_ptr<Process> process;
     };
 
+    // js Buffers are written as they are, the reference keeps them
+    // alive until they're done and is only ever touched on the js thread.
+    // the callback, if any, is called once the Buffer is released, the
+    // caller may not touch the data before that
+    struct PendingWrite
+    {
+        const char* data;
+        size_t size;
+        napi_ref buffer;
+        napi_ref callback;
+    };
+
     std::shared_ptr<Writer> writer;
-    std::vector<std::string> newPendingWrite;
-    std::deque<std::string> pendingWrite;
+    std::vector<PendingWrite> newPendingWrite;
+    std::deque<PendingWrite> pendingWrite;
     size_t pendingOffset { 0 };
+    bool writeQueued { false };
+    Counter bytesWritten;
+
+    ~Process();
 };
 
 enum ProcessMode {
@@ -137,26 +246,102 @@ static void setProcessMode(const std::shared_ptr<Process>& proc, uint32_t mode)
 struct Reader
 {
     Reader();
+    ~Reader();
+
+    // largest Buffer handed to a listener in one call, and for how
+    // long the reader thread may sit on output before waking js
+    std::atomic<uint32_t> batchBytes { 65536 };
+    std::atomic<uint32_t> batchLatency { 0 };
+    // reader thread only
+    size_t heldBytes { 0 };
+    uint64_t heldSince { 0 };
 
     uv_async_t async;
     Mutex mutex;
     uv_thread_t thread;
+    Poller poller;
     std::vector<std::shared_ptr<BufferEmitter> > pendingemitters;
-    std::vector<std::shared_ptr<Process> > newprocs, procs, exitedprocs, stoppedprocs;
+    std::vector<std::shared_ptr<Process> > newprocs, exitedprocs, stoppedprocs, failedprocs;
+    // processes that haven't been reported as exited or failed, for Stats().
+    // a process that dies unreported leaves an expired entry that Stats()
+    // prunes, its address may be reused by the next one which replaces it
+    std::unordered_map<Process*, std::weak_ptr<Process> > live;
+    // processes that haven't been reaped yet, reader thread only
+    std::unordered_map<pid_t, std::shared_ptr<Process> > children;
+    // reaped processes the poller still points at, reader thread only
+    std::vector<std::shared_ptr<Process> > draining;
+    bool usePidfd { true };
+    // processes that got new data or a close request from js
+    std::vector<std::shared_ptr<Process> > writeprocs;
+    // fds that were handed off to other processes
+    std::vector<std::pair<std::shared_ptr<Process>, int> > releasedfds;
+    // throttled emitters that js wants data from again
+    std::vector<std::shared_ptr<BufferEmitter> > resumedemitters;
+    // Buffer references of finished writes, deleted on the js thread.
+    // this has its own lock since processes may die with reader.mutex held
+    Mutex refmutex;
+    std::vector<Process::PendingWrite> finishedwrites;
+    napi_async_context writeContext { nullptr };
+    napi_env env { nullptr };
     int sigpipe[2];
     int wakeuppipe[2];
     bool stopped { true };
 
     void handleSigChld();
+    void handleChildExit(Process* proc);
+    void handleStatus(Process* proc, int status);
+    void watchChild(const std::shared_ptr<Process>& proc);
+    void forgetChild(Process* proc);
+    void scanChildren();
+    void handleExited(Process* proc);
+    void forgetLive(Process* proc);
+    void handleExec(Process* proc);
+    void handleData(size_t bytes);
+    int flushTimeout();
+    // wakes the js thread
+    void notify();
 
     void start(const Napi::Env& env);
     void stop(const Napi::Env& env);
 
     void add(const std::shared_ptr<Process>& proc);
+    void release(const std::shared_ptr<Process>& proc, int stream);
+    void releaseWrites(const std::vector<Process::PendingWrite>& writes);
 };
 
+// processes that outlive the reader at exit can't hand it their writes,
+// this has no destructor of its own so it's safe to look at from theirs
+static bool readerDestroyed = false;
 static Reader reader;
 
+inline void Reader::notify()
+{
+    counters.asyncSends.add();
+    uv_async_send(&async);
+}
+
+void Reader::releaseWrites(const std::vector<Process::PendingWrite>& writes)
+{
+    if (writes.empty())
+        return;
+    {
+        MutexLocker locker(&refmutex);
+        finishedwrites.insert(finishedwrites.end(), writes.begin(), writes.end());
+    }
+    notify();
+}
+
+Process::~Process()
+{
+    // picked up on the next wakeup, the reader might be stopped already.
+    // at exit there's no one left to release the references to
+    if (readerDestroyed)
+        return;
+    MutexLocker locker(&reader.refmutex);
+    reader.finishedwrites.insert(reader.finishedwrites.end(), newPendingWrite.begin(), newPendingWrite.end());
+    reader.finishedwrites.insert(reader.finishedwrites.end(), pendingWrite.begin(), pendingWrite.end());
+}
+
 struct State
 {
     Mutex mutex;
@@ -184,34 +369,220 @@ Reader::Reader()
     wakeuppipe[0] = wakeuppipe[1] = -1;
 }
 
+Reader::~Reader()
+{
+    // members go in reverse order, the processes have to go while
+    // refmutex and finishedwrites are still around
+    children.clear();
+    draining.clear();
+    newprocs.clear();
+    exitedprocs.clear();
+    stoppedprocs.clear();
+    failedprocs.clear();
+    writeprocs.clear();
+    releasedfds.clear();
+    readerDestroyed = true;
+}
+
 void Reader::add(const std::shared_ptr<Process>& proc)
 {
     int e;
     char c = 'a';
     MutexLocker locker(&mutex);
     newprocs.push_back(proc);
+    live[proc.get()] = proc;
+    EINTRWRAP(e, ::write(wakeuppipe[1], &c, 1));
+}
+
+void Reader::release(const std::shared_ptr<Process>& proc, int stream)
+{
+    int e;
+    char c = 'r';
+    MutexLocker locker(&mutex);
+    releasedfds.push_back(std::make_pair(proc, stream));
     EINTRWRAP(e, ::write(wakeuppipe[1], &c, 1));
 }
 
+// called with mutex held
+void Reader::forgetLive(Process* proc)
+{
+    live.erase(proc);
+}
+
+// whether the poller may still return events that point at proc
+static inline bool watched(const Process* proc)
+{
+    return proc->stdout != -1 || proc->stderr != -1 || proc->runpipe != -1 || proc->pidfd != -1 || proc->needsWrite;
+}
+
+// a stream nobody has claimed doesn't hold up the exit, the next stage
+// of a pipeline may only take it over after the previous one is gone.
+// whatever is left in the pipe waits for whoever claims it
+static inline bool streamDone(int fd, const std::shared_ptr<BufferEmitter>& emitter)
+{
+    return fd == -1 || (emitter && !emitter->claimed);
+}
+
+void Reader::handleExited(Process* proc)
+{
+    // hold off until we know whether the exec went through,
+    // a process that failed to launch is only reported as an error
+    if (!proc->exitReported && !proc->running && streamDone(proc->stdout, proc->emitStdout)
+        && streamDone(proc->stderr, proc->emitStderr) && proc->runpipe == -1 && !proc->failed) {
+        proc->exitReported = true;
+        // notify js
+        MutexLocker locker(&mutex);
+        exitedprocs.push_back(proc->shared_from_this());
+        forgetLive(proc);
+    }
+}
+
+void Reader::handleExec(Process* proc)
+{
+    // the child writes a byte if it fails to exec and
+    // the pipe closes on its own if it succeeds
+    int r, e;
+    char c;
+    EINTRWRAP(r, ::read(proc->runpipe, &c, 1));
+    if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    poller.remove(proc->runpipe, Poller::Read);
+    EINTRWRAP(e, ::close(proc->runpipe));
+    proc->runpipe = -1;
+    if (r != 0) {
+        proc->failed = true;
+        MutexLocker locker(&mutex);
+        failedprocs.push_back(proc->shared_from_this());
+        forgetLive(proc);
+    }
+    handleExited(proc);
+    notify();
+}
+
+void Reader::handleData(size_t bytes)
+{
+    heldBytes += bytes;
+    const uint32_t latency = batchLatency.load(std::memory_order_relaxed);
+    if (latency == 0 || heldBytes >= batchBytes.load(std::memory_order_relaxed)) {
+        heldBytes = 0;
+        heldSince = 0;
+        notify();
+    } else if (heldSince == 0) {
+        heldSince = uv_hrtime();
+    }
+}
+
+int Reader::flushTimeout()
+{
+    if (heldBytes == 0)
+        return -1;
+    const uint64_t elapsed = (uv_hrtime() - heldSince) / 1000000;
+    const uint32_t latency = batchLatency.load(std::memory_order_relaxed);
+    if (elapsed >= latency) {
+        heldBytes = 0;
+        heldSince = 0;
+        notify();
+        return -1;
+    }
+    return static_cast<int>(latency - elapsed);
+}
+
 void BufferEmitter::emit(char* data, size_t size)
 {
     //printf("emitting %zu\n", data.size());
     queue.push({ data, size });
+    outstanding.fetch_add(size, std::memory_order_relaxed);
 
     MutexLocker locker(&reader.mutex);
-    reader.pendingemitters.push_back(shared_from_this());
+    if (!scheduled) {
+        scheduled = true;
+        reader.pendingemitters.push_back(shared_from_this());
+    }
+}
+
+void BufferEmitter::deliver(const Napi::Env& env, std::vector<Data>& chunks, DeliverMode mode)
+{
+    const size_t max = reader.batchBytes.load(std::memory_order_relaxed);
+    auto call = [this, mode](const Napi::Value& buffer) {
+        // keep the listener alive even if it unregisters itself
+        auto a = async;
+        if (mode == DeliverMakeCallback) {
+            a->listener.MakeCallback(a->listener.Value(), { buffer }, a->ctx);
+        } else {
+            a->listener.Call(a->listener.Value(), { buffer });
+        }
+    };
+
+    size_t idx = 0;
+    while (idx < chunks.size()) {
+        // the listener may go away while we're calling it
+        if (!async) {
+            pending.insert(pending.end(), chunks.begin() + idx, chunks.end());
+            break;
+        }
+        // copying pays off for small reads only, a mostly full chunk
+        // costs less to hand over than to copy
+        const size_t small = BufferPool::BufferSize / 2;
+        size_t end = idx + 1, total = chunks[idx].size;
+        while (chunks[idx].size < small && end < chunks.size() && chunks[end].size < small && total + chunks[end].size <= max) {
+            total += chunks[end].size;
+            ++end;
+        }
+        if (end == idx + 1) {
+            // a lone chunk is handed over without copying
+            call(makeBuffer(env, chunks[idx].data, chunks[idx].size));
+        } else {
+            auto buffer = Napi::Buffer<char>::New(env, total);
+            char* out = buffer.Data();
+            for (size_t i = idx; i < end; ++i) {
+                memcpy(out, chunks[i].data, chunks[i].size);
+                out += chunks[i].size;
+                bufferPool.release(chunks[i].data);
+            }
+            call(buffer);
+        }
+        idx = end;
+    }
+    chunks.clear();
 }
 
-static void handleRead(int* fd, const std::shared_ptr<BufferEmitter>& emitter)
+// returns the number of bytes read
+static size_t handleRead(int* fd, const std::shared_ptr<BufferEmitter>& emitter)
 {
+    size_t total = 0;
     int e;
-    char buf[16384];
+    char* buf = nullptr;
     const int nfd = *fd;
     for (;;) {
-        EINTRWRAP(e, ::read(nfd, buf, sizeof(buf)));
+        if (emitter->outstanding.load(std::memory_order_relaxed) >= emitter->highWaterMark) {
+            MutexLocker locker(&reader.mutex);
+            // js might have resumed us in the meantime
+            if (emitter->outstanding.load(std::memory_order_relaxed) >= emitter->highWaterMark) {
+                reader.poller.remove(nfd, Poller::Read);
+                emitter->throttled = true;
+                counters.throttled.add();
+                break;
+            }
+        }
+        if (!buf) {
+            buf = bufferPool.acquire();
+        }
+        if (buf) {
+            EINTRWRAP(e, ::read(nfd, buf, BufferPool::BufferSize));
+            counters.reads.add();
+        } else {
+            // out of memory, the fd is level triggered and would wake
+            // us right back up for data we can't take, give up on it
+            e = -1;
+            errno = ENOMEM;
+        }
         if (e > 0) {
-            emitter->emit(strndup(buf, e), e);
+            // the buffer is handed over as is, js wraps it without copying
+            emitter->emit(buf, e);
+            buf = nullptr;
+            total += e;
         } else if (e == 0) {
+            reader.poller.remove(nfd, Poller::Read);
             EINTRWRAP(e, ::close(nfd));
             state.removeFD(nfd);
             *fd = -1;
@@ -219,43 +590,126 @@ static void handleRead(int* fd, const std::shared_ptr<BufferEmitter>& emitter)
         } else {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
                 break;
+            reader.poller.remove(nfd, Poller::Read);
             EINTRWRAP(e, ::close(nfd));
             state.removeFD(nfd);
             *fd = -1;
             break;
         }
     }
+    if (buf)
+        bufferPool.release(buf);
+    counters.bytesRead.add(total);
+    emitter->bytesRead.add(total);
+    return total;
 }
 
+#ifdef IOV_MAX
+enum { MaxIov = IOV_MAX < 1024 ? IOV_MAX : 1024 };
+#else
+enum { MaxIov = 1024 };
+#endif
+
 static void handleWrite(Process* proc)
 {
-    if (proc->stdin == -1) {
+    std::vector<Process::PendingWrite> done;
+    auto dropPending = [proc, &done]() {
+        done.insert(done.end(), proc->pendingWrite.begin(), proc->pendingWrite.end());
         proc->pendingWrite.clear();
+        proc->pendingOffset = 0;
+    };
+
+    if (proc->stdin == -1) {
+        dropPending();
+        reader.releaseWrites(done);
         return;
     }
 
-    int e;
+    iovec iov[MaxIov];
+    ssize_t e;
     while (!proc->pendingWrite.empty()) {
-        const auto& str = proc->pendingWrite.front();
-        EINTRWRAP(e, ::write(proc->stdin, &str[0] + proc->pendingOffset, str.size() - proc->pendingOffset));
+        int n = 0;
+        size_t offset = proc->pendingOffset;
+        for (auto it = proc->pendingWrite.begin(); it != proc->pendingWrite.end() && n < MaxIov; ++it, ++n) {
+            iov[n].iov_base = const_cast<char*>(it->data + offset);
+            iov[n].iov_len = it->size - offset;
+            offset = 0;
+        }
+        EINTRWRAP(e, ::writev(proc->stdin, iov, n));
+        counters.writes.add();
         if (e > 0) {
-            proc->pendingOffset += e;
-            if (proc->pendingOffset == str.size()) {
+            counters.bytesWritten.add(e);
+            proc->bytesWritten.add(e);
+            size_t written = e;
+            while (written > 0) {
+                const auto& front = proc->pendingWrite.front();
+                const size_t remaining = front.size - proc->pendingOffset;
+                if (written < remaining) {
+                    proc->pendingOffset += written;
+                    break;
+                }
+                written -= remaining;
                 proc->pendingOffset = 0;
+                done.push_back(front);
                 proc->pendingWrite.pop_front();
             }
         } else if (e < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // wait for the pipe to drain
+                counters.writesBlocked.add();
                 proc->needsWrite = true;
+                reader.poller.add(proc->stdin, Poller::Write, &proc->watches[Process::StreamStdin]);
             } else {
                 // badness has occurred
-                EINTRWRAP(e, ::close(proc->stdin));
+                if (proc->needsWrite) {
+                    proc->needsWrite = false;
+                    reader.poller.remove(proc->stdin, Poller::Write);
+                }
+                int c;
+                EINTRWRAP(c, ::close(proc->stdin));
                 state.removeFD(proc->stdin);
                 proc->stdin = -1;
+                dropPending();
             }
-            return;
+            break;
+        }
+    }
+    reader.releaseWrites(done);
+}
+
+static void flushWrites(Process* proc)
+{
+    {
+        MutexLocker locker(&reader.mutex);
+        proc->writeQueued = false;
+        if (!proc->newPendingWrite.empty()) {
+            std::move(std::begin(proc->newPendingWrite), std::end(proc->newPendingWrite), std::back_inserter(proc->pendingWrite));
+            proc->newPendingWrite.clear();
         }
     }
+    if (!proc->pendingWrite.empty() && !proc->needsWrite) {
+        handleWrite(proc);
+    }
+    if (proc->pendingWrite.empty() && proc->stdin != -1) {
+        MutexLocker locker(&reader.mutex);
+        if (proc->pendingClose) {
+            //printf("closing stdin\n");
+            int e;
+            proc->pendingClose = false;
+            EINTRWRAP(e, ::close(proc->stdin));
+            state.removeFD(proc->stdin);
+            proc->stdin = -1;
+        }
+    }
+}
+
+// called with reader.mutex held
+static void queueWrite(const std::shared_ptr<Process>& proc)
+{
+    if (!proc->writeQueued) {
+        proc->writeQueued = true;
+        reader.writeprocs.push_back(proc);
+    }
 }
 
 void Reader::start(const Napi::Env& env)
@@ -263,6 +717,7 @@ void Reader::start(const Napi::Env& env)
     if (sigpipe[0] != -1) {
         throw Napi::TypeError::New(env, "Reader already started");
     }
+    this->env = env;
     int r = pipe(sigpipe);
     if (r == -1) {
         // badness
@@ -295,6 +750,12 @@ void Reader::start(const Napi::Env& env)
     }
     fcntl(wakeuppipe[0], F_SETFL, r | O_NONBLOCK);
 
+    if (!poller.open()) {
+        throw Napi::TypeError::New(env, "Failed to create poller");
+    }
+    poller.add(wakeuppipe[0], Poller::Read, wakeuppipe);
+    poller.add(sigpipe[0], Poller::Read, sigpipe);
+
     uv_signal_init(uv_default_loop(), &state.chld);
     uv_signal_start(&state.chld, [](uv_signal_t*, int sig) {
         int e;
@@ -302,37 +763,68 @@ void Reader::start(const Napi::Env& env)
         EINTRWRAP(e, ::write(reader.sigpipe[1], &csig, 1));
     }, SIGCHLD);
 
+    napi_async_init(env, nullptr, Napi::String::New(env, "processWrite"), &writeContext);
+
     uv_async_init(uv_default_loop(), &async,
                   [](uv_async_t*) {
-                      std::vector<std::shared_ptr<Process> > ep, sp;
+                      counters.asyncCallbacks.add();
+                      std::vector<std::shared_ptr<Process> > ep, sp, fp;
                       std::vector<std::shared_ptr<BufferEmitter> > pe;
                       {
                           MutexLocker locker(&reader.mutex);
                           std::swap(ep, reader.exitedprocs);
+                          std::swap(fp, reader.failedprocs);
                           std::swap(sp, reader.stoppedprocs);
                           std::swap(pe, reader.pendingemitters);
+                          for (const auto& e : pe) {
+                              e->scheduled = false;
+                          }
+                      }
+                      std::vector<Process::PendingWrite> fw;
+                      {
+                          MutexLocker locker(&reader.refmutex);
+                          std::swap(fw, reader.finishedwrites);
+                      }
+                      for (const auto& w : fw) {
+                          napi_delete_reference(reader.env, w.buffer);
+                          if (!w.callback)
+                              continue;
+                          // written or dropped, the Buffer is the caller's again
+                          Napi::Env env(reader.env);
+                          Napi::HandleScope scope(env);
+                          napi_value value;
+                          napi_get_reference_value(env, w.callback, &value);
+                          napi_delete_reference(env, w.callback);
+                          napi_value result;
+                          if (napi_make_callback(env, reader.writeContext, env.Global(), value, 0, nullptr, &result) != napi_ok) {
+                              napi_value exception;
+                              napi_get_and_clear_last_exception(env, &exception);
+                              printf("write callback: exception from js: %s\n", Napi::Value(env, exception).ToString().Utf8Value().c_str());
+                          }
                       }
+                      counters.pendingEmitters.update(pe.size());
+                      std::vector<BufferEmitter::Data> chunks;
                       for (const auto& e : pe) {
+                          const size_t depth = e->queue.pop_all(chunks);
+                          if (!depth)
+                              continue;
+                          counters.queueDepth.update(depth);
                           if (e->async) {
                               auto env = e->async->listener.Env();
                               Napi::HandleScope scope(env);
-                              BufferEmitter::Data data;
-                              for (;;) {
-                                  if (!e->queue.pop(data))
-                                      break;
-                                  //printf("immediate %s\n", str.c_str());
-                                  e->async->listener.MakeCallback(e->async->listener.Value(), { BufferEmitter::makeBuffer(env, data.data, data.size) }, e->async->ctx);
-                              }
+                              e->deliver(env, chunks, BufferEmitter::DeliverMakeCallback);
                           } else {
-                              BufferEmitter::Data data;
-                              for (;;) {
-                                  if (!e->queue.pop(data))
-                                      break;
-                                  //printf("pending %s\n", str.c_str());
-                                  e->pending.emplace_back(std::move(data));
-                              }
+                              e->pending.insert(e->pending.end(), chunks.begin(), chunks.end());
+                              chunks.clear();
                           }
                       }
+                      for (const auto& p : fp) {
+                          auto env = p->callback->ctx.Env();
+                          Napi::HandleScope scope(env);
+                          Napi::CallbackScope callback(env, p->callback->ctx);
+
+                          p->callback->function.Call({ Napi::String::New(env, "error"), Napi::String::New(env, "Failed to launch process") });
+                      }
                       for (const auto& p : sp) {
                           auto env = p->callback->ctx.Env();
                           Napi::HandleScope scope(env);
@@ -353,75 +845,78 @@ void Reader::start(const Napi::Env& env)
     uv_thread_create(&thread,
                      [](void* arg) {
                          Reader* reader = static_cast<Reader*>(arg);
-                         fd_set rdfds;
-                         fd_set wrfds;
-                         const int pmax = std::max(reader->wakeuppipe[0], reader->sigpipe[0]);
+                         Poller::Event events[64];
+                         std::vector<std::shared_ptr<Process> > wp;
+                         std::vector<std::pair<std::shared_ptr<Process>, int> > rf;
+                         std::vector<std::shared_ptr<BufferEmitter> > re;
+                         std::vector<std::shared_ptr<Process> > np;
                          int e;
                          for (;;) {
                              //printf("top of thread\n");
-                             FD_ZERO(&rdfds);
-                             FD_ZERO(&wrfds);
-                             FD_SET(reader->wakeuppipe[0], &rdfds);
-                             FD_SET(reader->sigpipe[0], &rdfds);
-
-                             bool newproc = false;
-
                              {
                                  MutexLocker locker(&reader->mutex);
-                                 if (!reader->newprocs.empty()) {
-                                     //printf("got new procs\n");
-                                     reader->procs.reserve(reader->newprocs.size() + reader->procs.size());
-                                     std::move(std::begin(reader->newprocs), std::end(reader->newprocs), std::back_inserter(reader->procs));
-                                     reader->newprocs.clear();
-                                     newproc = true;
+                                 std::swap(np, reader->newprocs);
+                                 std::swap(wp, reader->writeprocs);
+                                 std::swap(rf, reader->releasedfds);
+                                 std::swap(re, reader->resumedemitters);
+                             }
+
+                             for (const auto& emitter : re) {
+                                 auto proc = emitter->process.lock();
+                                 if (!proc)
+                                     continue;
+                                 const int fd = emitter->stream == Process::StreamStdout ? proc->stdout : proc->stderr;
+                                 if (fd != -1) {
+                                     reader->poller.add(fd, Poller::Read, &proc->watches[emitter->stream]);
+                                 }
+                             }
+                             re.clear();
+
+                             for (const auto& r : rf) {
+                                 // the fd itself was closed by the launching thread
+                                 if (r.second == Process::StreamStdout) {
+                                     r.first->stdout = -1;
+                                 } else {
+                                     r.first->stderr = -1;
                                  }
+                                 reader->handleExited(r.first.get());
+                                 reader->notify();
                              }
+                             rf.clear();
 
-                             if (newproc) {
-                                 // make sure that our new processes are still alive
+                             if (!np.empty()) {
+                                 //printf("got new procs\n");
+                                 for (const auto& proc : np) {
+                                     reader->watchChild(proc);
+                                 }
+                                 np.clear();
+                                 // they might have stopped before we got to watch them
                                  reader->handleSigChld();
                              }
 
-                             int max = pmax;
-                             for (const auto& proc : reader->procs) {
-                                 if (proc->stdout != -1) {
-                                     FD_SET(proc->stdout, &rdfds);
-                                     if (proc->stdout > max)
-                                         max = proc->stdout;
-                                 }
-                                 if (proc->stderr != -1) {
-                                     FD_SET(proc->stderr, &rdfds);
-                                     if (proc->stderr > max)
-                                         max = proc->stderr;
-                                 }
-                                 {
-                                     MutexLocker locker(&reader->mutex);
-                                     if (!proc->newPendingWrite.empty()) {
-                                         std::move(std::begin(proc->newPendingWrite), std::end(proc->newPendingWrite), std::back_inserter(proc->pendingWrite));
-                                         proc->newPendingWrite.clear();
-                                     }
-                                 }
-                                 if (!proc->pendingWrite.empty() && !proc->needsWrite) {
-                                     handleWrite(proc.get());
-                                 }
-                                 if (proc->pendingWrite.empty() && proc->stdin != -1) {
-                                     MutexLocker locker(&reader->mutex);
-                                     if (proc->pendingClose) {
-                                         //printf("closing stdin\n");
-                                         proc->pendingClose = false;
-                                         EINTRWRAP(e, ::close(proc->stdin));
-                                         state.removeFD(proc->stdin);
-                                         proc->stdin = -1;
-                                     }
-                                 }
-                                 if (proc->stdin != -1 && proc->needsWrite) {
-                                     FD_SET(proc->stdin, &wrfds);
-                                 }
+                             for (const auto& proc : wp) {
+                                 flushWrites(proc.get());
                              }
+                             wp.clear();
 
-                             EINTRWRAP(e, ::select(max + 1, &rdfds, &wrfds, nullptr, nullptr));
-                             if (e > 0) {
-                                 if (FD_ISSET(reader->wakeuppipe[0], &rdfds)) {
+                             // nothing from the last wait refers to these anymore
+                             auto& draining = reader->draining;
+                             draining.erase(std::remove_if(draining.begin(), draining.end(),
+                                                           [](const std::shared_ptr<Process>& proc) {
+                                                               return !watched(proc.get());
+                                                           }), draining.end());
+
+                             const int n = reader->poller.wait(events, sizeof(events) / sizeof(events[0]), reader->flushTimeout());
+                             if (n < 0) {
+                                 // bad
+                                 continue;
+                             }
+                             counters.wakeups.add();
+                             counters.events.add(n);
+                             if (!n)
+                                 counters.timeouts.add();
+                             for (int i = 0; i < n; ++i) {
+                                 if (events[i].data == reader->wakeuppipe) {
                                      //printf("wakeup due to pipe\n");
                                      // deal with wakeup data
                                      unsigned char w;
@@ -436,50 +931,69 @@ void Reader::start(const Napi::Env& env)
                                      MutexLocker locker(&reader->mutex);
                                      if (reader->stopped)
                                          return;
-                                 }
-                                 if (FD_ISSET(reader->sigpipe[0], &rdfds)) {
+                                 } else if (events[i].data == reader->sigpipe) {
                                      //printf("wakeup due to signal\n");
                                      // deal with signal data
                                      unsigned char s;
                                      for (;;) {
                                          EINTRWRAP(e, ::read(reader->sigpipe[0], &s, 1));
                                          if (e == 1 && s == SIGCHLD) {
+                                             counters.sigchlds.add();
                                              reader->handleSigChld();
                                          }
                                          // should handle error other than EAGAIN/EWOULDBLOCK
                                          if (e == -1)
                                              break;
                                      }
-                                 }
-                                 for (const auto& proc : reader->procs) {
-                                     if (proc->stdout != -1 && FD_ISSET(proc->stdout, &rdfds)) {
-                                         //printf("wakeup due to stdout\n");
-                                         // deal with proc stdout
-                                         handleRead(&proc->stdout, proc->emitStdout);
-                                         if (!proc->running && proc->stdout == -1 && proc->stderr == -1) {
-                                             // notify js
-                                             MutexLocker locker(&reader->mutex);
-                                             reader->exitedprocs.push_back(proc);
+                                 } else {
+                                     const auto watch = static_cast<Process::Watch*>(events[i].data);
+                                     Process* proc = watch->process;
+                                     switch (watch->stream) {
+                                     case Process::StreamStdout:
+                                         if (proc->stdout != -1) {
+                                             //printf("wakeup due to stdout\n");
+                                             // deal with proc stdout
+                                             const size_t bytes = handleRead(&proc->stdout, proc->emitStdout);
+                                             if (proc->stdout == -1) {
+                                                 reader->handleExited(proc);
+                                                 reader->notify();
+                                             } else {
+                                                 reader->handleData(bytes);
+                                             }
                                          }
-                                         uv_async_send(&reader->async);
-                                     }
-                                     if (proc->stderr != -1 && FD_ISSET(proc->stderr, &rdfds)) {
-                                         //printf("wakeup due to stderr\n");
-                                         // deal with proc stderr
-                                         handleRead(&proc->stderr, proc->emitStderr);
-                                         if (!proc->running && proc->stdout == -1 && proc->stderr == -1) {
-                                             // notify js
-                                             MutexLocker locker(&reader->mutex);
-                                             reader->exitedprocs.push_back(proc);
+                                         break;
+                                     case Process::StreamStderr:
+                                         if (proc->stderr != -1) {
+                                             //printf("wakeup due to stderr\n");
+                                             // deal with proc stderr
+                                             const size_t bytes = handleRead(&proc->stderr, proc->emitStderr);
+                                             if (proc->stderr == -1) {
+                                                 reader->handleExited(proc);
+                                                 reader->notify();
+                                             } else {
+                                                 reader->handleData(bytes);
+                                             }
                                          }
-                                         uv_async_send(&reader->async);
-                                     }
-                                     if (proc->needsWrite && proc->stdin != -1 && FD_ISSET(proc->stdin, &wrfds)) {
-                                         proc->needsWrite = false;
+                                         break;
+                                     case Process::StreamStdin:
+                                         if (proc->needsWrite && proc->stdin != -1) {
+                                             proc->needsWrite = false;
+                                             reader->poller.remove(proc->stdin, Poller::Write);
+                                             flushWrites(proc);
+                                         }
+                                         break;
+                                     case Process::StreamExec:
+                                         if (proc->runpipe != -1) {
+                                             reader->handleExec(proc);
+                                         }
+                                         break;
+                                     case Process::StreamExit:
+                                         if (proc->pidfd != -1) {
+                                             reader->handleChildExit(proc);
+                                         }
+                                         break;
                                      }
                                  }
-                             } else if (e < 0) {
-                                 // bad
                              }
                          }
                      }, this);
@@ -502,45 +1016,151 @@ void Reader::stop(const Napi::Env& env)
 
     uv_thread_join(&thread);
 
+    // no one reaps or reads for these anymore, let them go while
+    // everything they touch on the way out is still around
+    children.clear();
+    draining.clear();
+
+    poller.close();
+
     EINTRWRAP(e, ::close(sigpipe[0]));
     EINTRWRAP(e, ::close(sigpipe[1]));
     sigpipe[0] = sigpipe[1] = -1;
 
     uv_close(reinterpret_cast<uv_handle_t*>(&reader.async), nullptr);
+    napi_async_destroy(env, writeContext);
+    writeContext = nullptr;
 
     uv_signal_stop(&state.chld);
 }
 
-void Reader::handleSigChld()
+void Reader::watchChild(const std::shared_ptr<Process>& proc)
+{
+    children[proc->pid] = proc;
+#ifdef SYS_pidfd_open
+    if (usePidfd) {
+        // works for zombies too, we're the only ones reaping this pid
+        proc->pidfd = syscall(SYS_pidfd_open, proc->pid, 0);
+        if (proc->pidfd == -1) {
+            if (errno == ENOSYS)
+                usePidfd = false;
+        } else {
+            fcntl(proc->pidfd, F_SETFD, FD_CLOEXEC);
+            poller.add(proc->pidfd, Poller::Read, &proc->watches[Process::StreamExit]);
+        }
+    }
+#else
+    usePidfd = false;
+#endif
+}
+
+void Reader::forgetChild(Process* proc)
+{
+    if (proc->pidfd != -1) {
+        int e;
+        poller.remove(proc->pidfd, Poller::Read);
+        EINTRWRAP(e, ::close(proc->pidfd));
+        proc->pidfd = -1;
+    }
+    // this might hold the last reference to the process, the
+    // poller may still hand out its streams until they're closed
+    auto child = std::move(children[proc->pid]);
+    children.erase(proc->pid);
+    if (watched(proc))
+        draining.push_back(std::move(child));
+}
+
+void Reader::handleStatus(Process* proc, int status)
+{
+    if (WIFSTOPPED(status)) {
+        // process suspended, notify js
+        MutexLocker locker(&mutex);
+        tcgetattr(STDIN_FILENO, &proc->tmodes);
+        proc->tmodesSaved = true;
+        proc->status = WSTOPSIG(status);
+        stoppedprocs.push_back(proc->shared_from_this());
+        counters.stops.add();
+        notify();
+    } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        counters.reaps.add();
+        proc->running = false;
+        if (WIFSIGNALED(status)) {
+            proc->status = -WTERMSIG(status);
+        } else {
+            proc->status = WEXITSTATUS(status);
+        }
+        // notify js if all done
+        handleExited(proc);
+        notify();
+        forgetChild(proc);
+    }
+}
+
+void Reader::handleChildExit(Process* proc)
 {
+    // handleStatus may drop the last reference
+    const auto self = proc->shared_from_this();
+    // a stop might still be pending in front of the exit
     int status;
     pid_t w;
-    for (const auto& proc : procs) {
+    for (;;) {
         EINTRWRAP(w, waitpid(proc->pid, &status, WNOHANG | WUNTRACED));
+        if (w <= 0) {
+            if (w == -1)
+                forgetChild(proc);
+            break;
+        }
+        handleStatus(proc, status);
+        if (proc->pidfd == -1)
+            break;
+    }
+}
+
+void Reader::scanChildren()
+{
+    std::vector<std::pair<Process*, int> > changed;
+    int status;
+    pid_t w;
+    for (const auto& child : children) {
+        EINTRWRAP(w, waitpid(child.first, &status, WNOHANG | WUNTRACED));
         if (w > 0) {
-            if (WIFSTOPPED(status)) {
-                // process suspended, notify js
-                MutexLocker locker(&mutex);
-                tcgetattr(STDIN_FILENO, &proc->tmodes);
-                proc->tmodesSaved = true;
-                proc->status = WSTOPSIG(status);
-                stoppedprocs.push_back(proc);
-                uv_async_send(&async);
-            } else {
-                proc->running = false;
-                if (WIFSIGNALED(status)) {
-                    proc->status = -WTERMSIG(status);
-                } else {
-                    proc->status = WEXITSTATUS(status);
-                }
-                if (proc->stdout == -1 && proc->stderr == -1) {
-                    // all done, notify js
-                    MutexLocker locker(&mutex);
-                    exitedprocs.push_back(proc);
-                    uv_async_send(&async);
-                }
-            }
+            changed.push_back(std::make_pair(child.second.get(), status));
+        }
+    }
+    // handleStatus may drop children, don't do that while iterating
+    for (const auto& c : changed) {
+        handleStatus(c.first, c.second);
+    }
+}
+
+void Reader::handleSigChld()
+{
+    if (!usePidfd) {
+        scanChildren();
+        return;
+    }
+
+    // exits come in through the pidfds, all we're after here are stops.
+    // peek at which child stopped so that we only wait on that one
+    for (;;) {
+        siginfo_t info;
+        info.si_pid = 0;
+        int r;
+        EINTRWRAP(r, waitid(P_ALL, 0, &info, WSTOPPED | WNOHANG | WNOWAIT));
+        if (r == -1 || info.si_pid == 0)
+            break;
+        auto it = children.find(info.si_pid);
+        if (it == children.end()) {
+            // not one of ours, it'll keep showing up in front of ours
+            scanChildren();
+            break;
         }
+        int status;
+        pid_t w;
+        EINTRWRAP(w, waitpid(info.si_pid, &status, WNOHANG | WUNTRACED));
+        if (w <= 0)
+            break;
+        handleStatus(it->second.get(), status);
     }
 }
 
@@ -562,14 +1182,33 @@ void Write(const Napi::CallbackInfo& info)
         throw Napi::TypeError::New(env, "Process is dead");
     }
 
+    if (!info[2].IsFunction() && !info[2].IsUndefined()) {
+        throw Napi::TypeError::New(env, "Third argument needs to be a function or undefined");
+    }
+
     if (info[1].IsBuffer()) {
         auto buf = info[1].As<Napi::Buffer<const char> >();
-        const std::string str(buf.Data(), buf.Length());
+        if (buf.Length() == 0) {
+            if (info[2].IsFunction())
+                info[2].As<Napi::Function>().Call({});
+            return;
+        }
+        napi_ref ref;
+        if (napi_create_reference(env, buf, 1, &ref) != napi_ok) {
+            throw Napi::TypeError::New(env, "Unable to reference buffer");
+        }
+        napi_ref callback = nullptr;
+        if (info[2].IsFunction() && napi_create_reference(env, info[2], 1, &callback) != napi_ok) {
+            napi_delete_reference(env, ref);
+            throw Napi::TypeError::New(env, "Unable to reference callback");
+        }
         MutexLocker locker(&reader.mutex);
-        proc->newPendingWrite.push_back(std::move(str));
+        proc->newPendingWrite.push_back({ buf.Data(), buf.Length(), ref, callback });
+        queueWrite(proc);
     } else if (info[1].IsUndefined()) {
         MutexLocker locker(&reader.mutex);
         proc->pendingClose = true;
+        queueWrite(proc);
     } else {
         throw Napi::TypeError::New(env, "Data is not a buffer or undefined");
     }
@@ -599,6 +1238,7 @@ void Close(const Napi::CallbackInfo& info)
 
     MutexLocker locker(&reader.mutex);
     proc->pendingClose = true;
+    queueWrite(proc);
 
     int e;
     char c = 'w';
@@ -639,6 +1279,45 @@ Napi::Value SetMode(const Napi::CallbackInfo& info)
     return env.Undefined();
 }
 
+static void claimEmitter(const Napi::Env& env, const std::shared_ptr<BufferEmitter>& emitter)
+{
+    if (emitter->claimed)
+        return;
+    emitter->claimed = true;
+
+    auto proc = emitter->process.lock();
+    if (!proc) {
+        throw Napi::TypeError::New(env, "Process is dead");
+    }
+    const int fd = emitter->stream == Process::StreamStdout ? proc->stdout : proc->stderr;
+    reader.poller.add(fd, Poller::Read, &proc->watches[emitter->stream]);
+}
+
+void Resume(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsObject()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a ctx");
+    }
+
+    auto emitter = Wrap<std::shared_ptr<BufferEmitter> >::unwrap(info[0]);
+    if (!emitter) {
+        throw Napi::TypeError::New(env, "First argument is not a ctx");
+    }
+
+    MutexLocker locker(&reader.mutex);
+    emitter->outstanding.store(0, std::memory_order_relaxed);
+    if (emitter->throttled) {
+        emitter->throttled = false;
+        reader.resumedemitters.push_back(emitter);
+
+        int e;
+        char c = 'r';
+        EINTRWRAP(e, ::write(reader.wakeuppipe[1], &c, 1));
+    }
+}
+
 void Listen(const Napi::CallbackInfo& info)
 {
     auto env = info.Env();
@@ -656,47 +1335,179 @@ void Listen(const Napi::CallbackInfo& info)
         throw Napi::TypeError::New(env, "Second argument needs to be a function or undefined");
     }
 
+    if (!info[2].IsNumber() && !info[2].IsUndefined()) {
+        throw Napi::TypeError::New(env, "Third argument needs to be a number or undefined");
+    }
+
     if (info[1].IsFunction()) {
         if (emitter->async) {
             throw Napi::TypeError::New(env, "Emitter already got a listener");
         }
+        if (info[2].IsNumber()) {
+            const int64_t hwm = info[2].As<Napi::Number>().Int64Value();
+            if (hwm < 1) {
+                throw Napi::TypeError::New(env, "High water mark needs to be positive");
+            }
+            // only touched by the reader thread once we're claimed
+            if (!emitter->claimed) {
+                emitter->highWaterMark = hwm;
+            }
+        }
         emitter->async = std::make_shared<BufferEmitter::Async>(Napi::Persistent(info[1].As<Napi::Function>()), Napi::AsyncContext(env, "bufferEmitter"));
         if (!emitter->pending.empty()) {
-            for (auto& str : emitter->pending) {
-                emitter->async->listener.Call(emitter->async->listener.Value(), { BufferEmitter::makeBuffer(env, str.data, str.size) });
-            }
-            emitter->pending.clear();
+            std::vector<BufferEmitter::Data> chunks;
+            std::swap(chunks, emitter->pending);
+            emitter->deliver(env, chunks, BufferEmitter::DeliverCall);
         }
     } else {
         emitter->async.reset();
     }
+
+    claimEmitter(env, emitter);
 }
 
-static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>& proc, const ProcessOptions& opts, const std::vector<ProcessRedirection>& redirs)
+// argv and envp are built before we fork, the child should only
+// do async-signal-safe things between fork() and execve()
+struct ExecArgs
 {
-    // we'll need to notify the parent if we can't exec,
-    // create a pipe with CLOEXEC and write to it if
-    // we fail
+    std::vector<std::string> envStrings;
+    std::vector<char*> argv, envp;
+};
 
-    int runpipe[2];
-    ::pipe(runpipe);
-    fcntl(runpipe[1], F_SETFD, fcntl(runpipe[1], F_GETFD) | FD_CLOEXEC);
+static void buildExecArgs(Process* proc, ExecArgs& args)
+{
+    args.argv.reserve(proc->args.size() + 2);
+    args.argv.push_back(&proc->cmd[0]);
+    for (std::string& arg : proc->args) {
+        args.argv.push_back(&arg[0]);
+    }
+    args.argv.push_back(nullptr);
 
-    int stdinpipe[2] = { -1, -1 };
-    if (opts.redirectStdin) {
-        ::pipe(stdinpipe);
+    args.envStrings.reserve(proc->env.size());
+    for (const auto& env : proc->env) {
+        args.envStrings.push_back(env.first + "=" + env.second);
+    }
+    args.envp.reserve(proc->env.size() + 1);
+    for (std::string& env : args.envStrings) {
+        args.envp.push_back(&env[0]);
     }
+    args.envp.push_back(nullptr);
+}
 
-    int stdoutpipe[2] = { -1, -1 };
-    if (opts.redirectStdout) {
-        ::pipe(stdoutpipe);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP
+#endif
+
+static bool forceFork = false;
+
+static bool canSpawn(const ProcessOptions& opts, const std::vector<ProcessRedirection>& redirs)
+{
+    if (forceFork)
+        return false;
+#ifndef HAVE_SPAWN_TCSETPGRP
+    // the child needs to take the terminal before it execs
+    if (opts.interactive && opts.foreground)
+        return false;
+#endif
+    // failing to open a file is reported from the child, see forkProcess
+    for (const auto& redir : redirs) {
+        if (redir.io == ProcessRedirection::IO_File)
+            return false;
     }
+    return true;
+}
 
-    int stderrpipe[2] = { -1, -1 };
+// posix_spawn doesn't copy our page tables (glibc uses CLONE_VM | CLONE_VFORK)
+// and reports exec failures synchronously through its return value
+static int spawnProcess(pid_t* pid, Process* proc, const ProcessOptions& opts, const std::vector<ProcessRedirection>& redirs,
+                        const ExecArgs& args, const int stdinpipe[2], const int stdoutpipe[2], const int stderrpipe[2], int stdinfd)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    short flags = POSIX_SPAWN_SETSIGDEF;
+    sigset_t sigdef;
+    sigemptyset(&sigdef);
+    sigaddset(&sigdef, SIGINT);
+    sigaddset(&sigdef, SIGQUIT);
+    sigaddset(&sigdef, SIGTSTP);
+    sigaddset(&sigdef, SIGTTIN);
+    sigaddset(&sigdef, SIGTTOU);
+    sigaddset(&sigdef, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &sigdef);
+
+    if (opts.interactive) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, opts.pgid > 0 ? opts.pgid : 0);
+#ifdef HAVE_SPAWN_TCSETPGRP
+        if (opts.foreground) {
+            posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+        }
+#endif
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    // same order as the child in forkProcess
+    if (opts.redirectStdin) {
+        posix_spawn_file_actions_addclose(&actions, stdinpipe[1]);
+        posix_spawn_file_actions_adddup2(&actions, stdinpipe[0], STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, stdinpipe[0]);
+    } else if (stdinfd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, stdinfd, STDIN_FILENO);
+    }
+    if (opts.redirectStdout) {
+        posix_spawn_file_actions_addclose(&actions, stdoutpipe[0]);
+        posix_spawn_file_actions_adddup2(&actions, stdoutpipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, stdoutpipe[1]);
+    } else {
+        posix_spawn_file_actions_adddup2(&actions, opts.originalStdout, STDOUT_FILENO);
+    }
     if (opts.redirectStderr) {
-        ::pipe(stderrpipe);
+        posix_spawn_file_actions_addclose(&actions, stderrpipe[0]);
+        posix_spawn_file_actions_adddup2(&actions, stderrpipe[1], STDERR_FILENO);
+        posix_spawn_file_actions_addclose(&actions, stderrpipe[1]);
+    } else {
+        posix_spawn_file_actions_adddup2(&actions, opts.originalStderr, STDERR_FILENO);
+    }
+
+    {
+        // close any pending pipes for other processes
+        MutexLocker locker(&state.mutex);
+        for (const int fd : state.closeme) {
+            posix_spawn_file_actions_addclose(&actions, fd);
+        }
     }
 
+    if (!opts.redirectStdin && stdinfd == -1) {
+        // dup2 onto itself clears FD_CLOEXEC, same as the dup dance in forkProcess
+        posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDIN_FILENO);
+    }
+
+    for (const auto& redir : redirs) {
+        assert(redir.io == ProcessRedirection::IO_FD);
+        posix_spawn_file_actions_adddup2(&actions, redir.destFD, redir.sourceFD);
+    }
+
+    const int ret = posix_spawn(pid, proc->cmd.c_str(), &actions, &attr, args.argv.data(), args.envp.data());
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return ret;
+}
+
+static pid_t forkProcess(int* runfd, const ProcessOptions& opts, const std::vector<ProcessRedirection>& redirs,
+                         const ExecArgs& args, const int stdinpipe[2], const int stdoutpipe[2], const int stderrpipe[2], int stdinfd)
+{
+    // we'll need to notify the parent if we can't exec,
+    // create a pipe with CLOEXEC and write to it if
+    // we fail
+
+    int runpipe[2];
+    ::pipe(runpipe);
+    fcntl(runpipe[1], F_SETFD, fcntl(runpipe[1], F_GETFD) | FD_CLOEXEC);
+
     int e;
 
     const pid_t pid = fork();
@@ -725,6 +1536,8 @@ static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>
             EINTRWRAP(e, ::close(stdinpipe[1]));
             EINTRWRAP(e, dup2(stdinpipe[0], STDIN_FILENO));
             EINTRWRAP(e, ::close(stdinpipe[0]));
+        } else if (stdinfd != -1) {
+            EINTRWRAP(e, dup2(stdinfd, STDIN_FILENO));
         }
         if (opts.redirectStdout) {
             EINTRWRAP(e, ::close(stdoutpipe[0]));
@@ -749,22 +1562,7 @@ static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>
             }
         }
 
-        const char** argv = reinterpret_cast<const char**>(malloc((proc->args.size() + 2) * sizeof(char*)));
-        argv[0] = strdup(proc->cmd.c_str());
-        argv[proc->args.size() + 1] = 0;
-        int idx = 0;
-        for (const std::string& arg : proc->args) {
-            argv[++idx] = strdup(arg.c_str());
-        }
-
-        char** envp = reinterpret_cast<char**>(malloc((proc->env.size() + 1) * sizeof(char*)));
-        envp[proc->env.size()] = 0;
-        idx = 0;
-        for (const auto& env : proc->env) {
-            envp[idx++] = strdup((env.first + "=" + env.second).c_str());
-        }
-
-        if (!opts.redirectStdin) {
+        if (!opts.redirectStdin && stdinfd == -1) {
             // I really have NO idea why I have to do this but it seems to fix issues
 
             int dupped;
@@ -818,7 +1616,7 @@ static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>
             }
         }
 
-        execve(proc->cmd.c_str(), const_cast<char*const*>(argv), envp);
+        execve(args.argv[0], args.argv.data(), args.envp.data());
 
         // notify parent
         char c = 1;
@@ -826,146 +1624,217 @@ static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>
         EINTRWRAP(e, ::close(runpipe[1]));
 
         _exit(-1);
-    } else if (pid > 0) {
-        // parent
+    }
 
-        const pid_t pgid = opts.pgid > 0 ? opts.pgid : pid;
-        if (opts.interactive) {
-            setpgid(pid, pgid);
-            if (opts.foreground) {
-                tcsetpgrp(STDIN_FILENO, pgid);
-            }
+    // parent
+    EINTRWRAP(e, ::close(runpipe[1]));
+    if (pid < 0) {
+        EINTRWRAP(e, ::close(runpipe[0]));
+        *runfd = -1;
+        return pid;
+    }
+
+    // the reader thread waits for the exec, see Reader::handleExec
+    fcntl(runpipe[0], F_SETFD, fcntl(runpipe[0], F_GETFD) | FD_CLOEXEC);
+    fcntl(runpipe[0], F_SETFL, fcntl(runpipe[0], F_GETFL) | O_NONBLOCK);
+    *runfd = runpipe[0];
+    return pid;
+}
+
+static Napi::Object launchProcess(const Napi::Env& env, std::shared_ptr<Process>& proc, const ProcessOptions& opts, const std::vector<ProcessRedirection>& redirs)
+{
+    // take over the read end of another process' output, the
+    // reader thread has never polled it so nothing has been consumed
+    std::shared_ptr<Process> stdinProc;
+    int stdinfd = -1;
+    if (opts.stdinFrom) {
+        if (opts.stdinFrom->claimed) {
+            throw Napi::TypeError::New(env, "stdinFrom is already being read");
+        }
+        stdinProc = opts.stdinFrom->process.lock();
+        if (!stdinProc) {
+            throw Napi::TypeError::New(env, "stdinFrom process is dead");
         }
+        opts.stdinFrom->claimed = true;
+        stdinfd = opts.stdinFrom->stream == Process::StreamStdout ? stdinProc->stdout : stdinProc->stderr;
+
+        // the pipe was made non-blocking for the reader thread,
+        // nobody on our side is going to read it again
+        const int fl = fcntl(stdinfd, F_GETFL);
+        if (fl != -1) {
+            fcntl(stdinfd, F_SETFL, fl & ~O_NONBLOCK);
+        }
+    }
+
+    const uint64_t launchStart = uv_hrtime();
+    counters.launches.add();
 
+    ExecArgs args;
+    buildExecArgs(proc.get(), args);
+
+    int stdinpipe[2] = { -1, -1 };
+    if (opts.redirectStdin) {
+        ::pipe(stdinpipe);
+    }
+
+    int stdoutpipe[2] = { -1, -1 };
+    if (opts.redirectStdout) {
+        ::pipe(stdoutpipe);
+    }
+
+    int stderrpipe[2] = { -1, -1 };
+    if (opts.redirectStderr) {
+        ::pipe(stderrpipe);
+    }
+
+    int e;
+    pid_t pid = -1;
+    int runfd = -1;
+    bool ok = false;
+    bool spawned = false;
+    if (canSpawn(opts, redirs)) {
+        const int err = spawnProcess(&pid, proc.get(), opts, redirs, args, stdinpipe, stdoutpipe, stderrpipe, stdinfd);
+        // glibc fails the whole spawn with EPERM if the group in pgid is
+        // gone (the leader may have been reaped already) or isn't a group,
+        // the child of a fork ignores a failed setpgid like it always has
+        spawned = !(err == EPERM && opts.interactive && opts.pgid > 0);
+        ok = err == 0;
+    }
+    if (!spawned) {
+        // doesn't wait for the exec, failures are reported
+        // asynchronously through the status callback
+        pid = forkProcess(&runfd, opts, redirs, args, stdinpipe, stdoutpipe, stderrpipe, stdinfd);
+        ok = pid > 0;
+    }
+
+    const pid_t pgid = opts.pgid > 0 ? opts.pgid : pid;
+    if (pid > 0 && opts.interactive) {
+        setpgid(pid, pgid);
+        if (opts.foreground) {
+            tcsetpgrp(STDIN_FILENO, pgid);
+        }
+    }
+
+    if (opts.redirectStdin) {
+        EINTRWRAP(e, ::close(stdinpipe[0]));
+    }
+    if (opts.redirectStdout) {
+        EINTRWRAP(e, ::close(stdoutpipe[1]));
+    }
+    if (opts.redirectStderr) {
+        EINTRWRAP(e, ::close(stderrpipe[1]));
+    }
+    if (stdinfd != -1) {
+        // the child owns it now
+        state.removeFD(stdinfd);
+        EINTRWRAP(e, ::close(stdinfd));
+        reader.release(stdinProc, opts.stdinFrom->stream);
+    }
+
+    if (!ok) {
         if (opts.redirectStdin) {
-            EINTRWRAP(e, ::close(stdinpipe[0]));
+            EINTRWRAP(e, ::close(stdinpipe[1]));
         }
         if (opts.redirectStdout) {
-            EINTRWRAP(e, ::close(stdoutpipe[1]));
+            EINTRWRAP(e, ::close(stdoutpipe[0]));
         }
         if (opts.redirectStderr) {
-            EINTRWRAP(e, ::close(stderrpipe[1]));
+            EINTRWRAP(e, ::close(stderrpipe[0]));
         }
 
-        bool ok = true;
-        EINTRWRAP(e, ::close(runpipe[1]));
-        fd_set rdfds;
-        for (;;) {
-            FD_ZERO(&rdfds);
-            FD_SET(runpipe[0], &rdfds);
-            EINTRWRAP(e, ::select(runpipe[0] + 1, &rdfds, 0, 0, 0));
-            if (e == -1) {
-                // not good
-                ok = false;
-                break;
-            } else if (e > 0 && FD_ISSET(runpipe[0], &rdfds)) {
-                char c;
-                EINTRWRAP(e, ::read(runpipe[0], &c, 1));
-                if (e == -1 || e == 1) {
-                    // job went bad
-                    ok = false;
-                }
-                EINTRWRAP(e, ::close(runpipe[0]));
-                break;
-            }
-        }
+        auto env = proc->callback->ctx.Env();
+        Napi::HandleScope scope(env);
+        Napi::CallbackScope callback(env, proc->callback->ctx);
 
-        if (!ok) {
-            if (opts.redirectStdin) {
-                EINTRWRAP(e, ::close(stdinpipe[1]));
-            }
-            if (opts.redirectStdout) {
-                EINTRWRAP(e, ::close(stdoutpipe[0]));
-            }
-            if (opts.redirectStderr) {
-                EINTRWRAP(e, ::close(stderrpipe[0]));
-            }
-
-            auto env = proc->callback->ctx.Env();
-            Napi::HandleScope scope(env);
-            Napi::CallbackScope callback(env, proc->callback->ctx);
+        counters.launchFailures.add();
+        proc->callback->function.Call({ Napi::String::New(env, "error"), Napi::String::New(env, "Failed to launch process") });
+        proc.reset();
+    } else {
+        // add this process to our read list
+        proc->stdin = stdinpipe[1];
+        proc->stdout = stdoutpipe[0];
+        proc->stderr = stderrpipe[0];
 
-            proc->callback->function.Call({ Napi::String::New(env, "error"), Napi::String::New(env, "Failed to launch process") });
-            proc.reset();
-        } else {
-            // add this process to our read list
-            proc->stdin = stdinpipe[1];
-            proc->stdout = stdoutpipe[0];
-            proc->stderr = stderrpipe[0];
-
-            if (opts.redirectStdin) {
-                e = fcntl(proc->stdin, F_GETFL);
-                if (e != -1) {
-                    fcntl(proc->stdin, F_SETFL, e | O_NONBLOCK);
-                }
-                MutexLocker locker(&state.mutex);
-                state.closeme.push_back(proc->stdin);
+        if (opts.redirectStdin) {
+            e = fcntl(proc->stdin, F_GETFL);
+            if (e != -1) {
+                fcntl(proc->stdin, F_SETFL, e | O_NONBLOCK);
             }
-            if (opts.redirectStdout) {
-                e = fcntl(proc->stdout, F_GETFL);
-                if (e != -1) {
-                    fcntl(proc->stdout, F_SETFL, e | O_NONBLOCK);
-                }
-                MutexLocker locker(&state.mutex);
-                state.closeme.push_back(proc->stdout);
+            MutexLocker locker(&state.mutex);
+            state.closeme.push_back(proc->stdin);
+        }
+        if (opts.redirectStdout) {
+            e = fcntl(proc->stdout, F_GETFL);
+            if (e != -1) {
+                fcntl(proc->stdout, F_SETFL, e | O_NONBLOCK);
             }
-            if (opts.redirectStderr) {
-                e = fcntl(proc->stderr, F_GETFL);
-                if (e != -1) {
-                    fcntl(proc->stderr, F_SETFL, e | O_NONBLOCK);
-                }
-                MutexLocker locker(&state.mutex);
-                state.closeme.push_back(proc->stderr);
+            MutexLocker locker(&state.mutex);
+            state.closeme.push_back(proc->stdout);
+        }
+        if (opts.redirectStderr) {
+            e = fcntl(proc->stderr, F_GETFL);
+            if (e != -1) {
+                fcntl(proc->stderr, F_SETFL, e | O_NONBLOCK);
             }
+            MutexLocker locker(&state.mutex);
+            state.closeme.push_back(proc->stderr);
+        }
 
-            proc->pid = pid;
-            proc->pgid = pgid;
-            proc->running = true;
+        proc->pid = pid;
+        proc->pgid = pgid;
+        proc->running = true;
 
-            if (opts.redirectStderr) {
-                proc->emitStderr = std::make_shared<BufferEmitter>();
-            }
-            if (opts.redirectStdout) {
-                proc->emitStdout = std::make_shared<BufferEmitter>();
-            }
-            if (opts.redirectStdin) {
-                proc->writer = std::make_shared<Process::Writer>();
-                proc->writer->process = proc;
-            }
-
-            reader.add(proc);
+        if (runfd != -1) {
+            proc->runpipe = runfd;
+            reader.poller.add(runfd, Poller::Read, &proc->watches[Process::StreamExec]);
         }
 
-        auto obj = Napi::Object::New(env);
-        if (proc) {
-            if (opts.redirectStderr) {
-                obj.Set("stderrCtx", Wrap<std::shared_ptr<BufferEmitter> >::wrap(env, proc->emitStderr));
-            }
-            if (opts.redirectStdout) {
-                obj.Set("stdoutCtx", Wrap<std::shared_ptr<BufferEmitter> >::wrap(env, proc->emitStdout));
-            }
-            if (opts.redirectStdin) {
-                obj.Set("stdinCtx", Wrap<std::shared_ptr<Process::Writer> >::wrap(env, proc->writer));
-            }
-            obj.Set("processCtx", Wrap<std::shared_ptr<Process> >::wrap(env, proc));
+        if (opts.redirectStderr) {
+            proc->emitStderr = std::make_shared<BufferEmitter>();
+            proc->emitStderr->process = proc;
+            proc->emitStderr->stream = Process::StreamStderr;
+        }
+        if (opts.redirectStdout) {
+            proc->emitStdout = std::make_shared<BufferEmitter>();
+            proc->emitStdout->process = proc;
+            proc->emitStdout->stream = Process::StreamStdout;
+        }
+        if (opts.redirectStdin) {
+            proc->writer = std::make_shared<Process::Writer>();
+            proc->writer->process = proc;
         }
-        obj.Set("listen", Napi::Function::New(env, Listen));
-        obj.Set("write", Napi::Function::New(env, Write));
-        obj.Set("close", Napi::Function::New(env, Close));
-        obj.Set("pid", Napi::Number::New(env, pid));
-        obj.Set("setMode", Napi::Function::New(env, SetMode));
 
-        return obj;
-    } else {
-        // error
+        reader.add(proc);
+        counters.launchLatency.add((uv_hrtime() - launchStart) / 1000);
     }
 
-    // can't happen
-    __builtin_unreachable();
+    auto obj = Napi::Object::New(env);
+    if (proc) {
+        if (opts.redirectStderr) {
+            obj.Set("stderrCtx", Wrap<std::shared_ptr<BufferEmitter> >::wrap(env, proc->emitStderr));
+        }
+        if (opts.redirectStdout) {
+            obj.Set("stdoutCtx", Wrap<std::shared_ptr<BufferEmitter> >::wrap(env, proc->emitStdout));
+        }
+        if (opts.redirectStdin) {
+            obj.Set("stdinCtx", Wrap<std::shared_ptr<Process::Writer> >::wrap(env, proc->writer));
+        }
+        obj.Set("processCtx", Wrap<std::shared_ptr<Process> >::wrap(env, proc));
+    }
+    obj.Set("listen", Napi::Function::New(env, Listen));
+    obj.Set("resume", Napi::Function::New(env, Resume));
+    obj.Set("write", Napi::Function::New(env, Write));
+    obj.Set("close", Napi::Function::New(env, Close));
+    obj.Set("pid", Napi::Number::New(env, pid));
+    obj.Set("setMode", Napi::Function::New(env, SetMode));
+
+    return obj;
 }
 
 void Start(const Napi::CallbackInfo& info)
 {
+    // lets us compare the two launch paths, see tests/bench/launch.js
+    forceFork = getenv("JSH_FORCE_FORK") != nullptr;
     reader.start(info.Env());
 }
 
@@ -974,30 +1843,24 @@ void Stop(const Napi::CallbackInfo& info)
     reader.stop(info.Env());
 }
 
-Napi::Value Launch(const Napi::CallbackInfo& info)
+static std::vector<std::string> parseArgs(const Napi::Value& value)
 {
-    auto env = info.Env();
-
-    if (!info[0].IsString()) {
-        throw Napi::TypeError::New(env, "First argument needs to be a string");
-    }
-
-    auto proc = std::make_shared<Process>();
-    proc->cmd = info[0].As<Napi::String>().Utf8Value();
-
-    if (info[1].IsArray()) {
-        std::vector<std::string> args;
-        const auto array = info[1].As<Napi::Array>();
+    std::vector<std::string> args;
+    if (value.IsArray()) {
+        const auto array = value.As<Napi::Array>();
         args.reserve(array.Length());
         for (size_t i = 0; i < array.Length(); ++i) {
             args.push_back(array.Get(i).As<Napi::String>().Utf8Value());
         }
-        proc->args = std::move(args);
     }
+    return args;
+}
 
-    if (info[2].IsObject()) {
-        std::vector<std::pair<std::string, std::string> > envs;
-        auto obj = info[2].As<Napi::Object>();
+static std::vector<std::pair<std::string, std::string> > parseEnv(const Napi::Value& value)
+{
+    std::vector<std::pair<std::string, std::string> > envs;
+    if (value.IsObject()) {
+        auto obj = value.As<Napi::Object>();
         const auto props = obj.GetPropertyNames();
         envs.reserve(props.Length());
         for (size_t i = 0; i < props.Length(); ++i) {
@@ -1007,22 +1870,16 @@ Napi::Value Launch(const Napi::CallbackInfo& info)
                 envs.push_back(std::make_pair(k.As<Napi::String>().Utf8Value(), v.As<Napi::String>().Utf8Value()));
             }
         }
-        proc->env = std::move(envs);
     }
+    return envs;
+}
 
-    if (!info[3].IsFunction()) {
-        throw Napi::TypeError::New(env, "Fourth argument needs to be a status callback function");
-    }
-    proc->callback = std::make_unique<AsyncFunction>(Napi::Persistent(info[3].As<Napi::Function>()), Napi::AsyncContext(env, "process"));
-
+static ProcessOptions parseOptions(const Napi::Env& env, const Napi::Object& optsobj)
+{
     ProcessOptions opts = {
-        true, true, true, false, false, -1, -1, -1
+        true, true, true, false, false, -1, -1, -1, nullptr
     };
-    if (!info[4].IsObject()) {
-        throw Napi::TypeError::New(env, "Fifth argument needs to be an options object");
-    }
 
-    auto optsobj = info[4].As<Napi::Object>();
     opts.redirectStdin = optsobj.Get("redirectStdin").As<Napi::Boolean>().Value();
     opts.redirectStdout = optsobj.Get("redirectStdout").As<Napi::Boolean>().Value();
     opts.redirectStderr = optsobj.Get("redirectStderr").As<Napi::Boolean>().Value();
@@ -1038,10 +1895,22 @@ Napi::Value Launch(const Napi::CallbackInfo& info)
             opts.pgid = pgid.As<Napi::Number>().Int32Value();
         }
     }
+    const auto stdinFromValue = optsobj.Get("stdinFrom");
+    if (stdinFromValue.IsObject()) {
+        opts.stdinFrom = Wrap<std::shared_ptr<BufferEmitter> >::unwrap(stdinFromValue);
+        if (!opts.stdinFrom) {
+            throw Napi::TypeError::New(env, "stdinFrom is not an output ctx");
+        }
+        opts.redirectStdin = false;
+    }
+    return opts;
+}
 
+static std::vector<ProcessRedirection> parseRedirections(const Napi::Value& value)
+{
     std::vector<ProcessRedirection> redirs;
-    if (info[5].IsArray()) {
-        const auto arr = info[5].As<Napi::Array>();
+    if (value.IsArray()) {
+        const auto arr = value.As<Napi::Array>();
         for (size_t i = 0; i < arr.Length(); ++i) {
             const auto rv = arr.Get(i);
             if (rv.IsObject()) {
@@ -1060,8 +1929,127 @@ Napi::Value Launch(const Napi::CallbackInfo& info)
             }
         }
     }
+    return redirs;
+}
+
+Napi::Value Launch(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
 
-    return launchProcess(env, proc, opts, redirs);
+    auto proc = std::make_shared<Process>();
+    proc->cmd = info[0].As<Napi::String>().Utf8Value();
+    proc->args = parseArgs(info[1]);
+    proc->env = parseEnv(info[2]);
+
+    if (!info[3].IsFunction()) {
+        throw Napi::TypeError::New(env, "Fourth argument needs to be a status callback function");
+    }
+    proc->callback = std::make_unique<AsyncFunction>(Napi::Persistent(info[3].As<Napi::Function>()), Napi::AsyncContext(env, "process"));
+
+    if (!info[4].IsObject()) {
+        throw Napi::TypeError::New(env, "Fifth argument needs to be an options object");
+    }
+    const ProcessOptions opts = parseOptions(env, info[4].As<Napi::Object>());
+
+    return launchProcess(env, proc, opts, parseRedirections(info[5]));
+}
+
+Napi::Value LaunchPipeline(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsArray()) {
+        throw Napi::TypeError::New(env, "First argument needs to be an array of stages");
+    }
+    if (!info[1].IsObject()) {
+        throw Napi::TypeError::New(env, "Second argument needs to be an options object");
+    }
+
+    // validate everything up front, we don't want to throw
+    // after some of the stages have been launched
+    const auto stages = info[0].As<Napi::Array>();
+    const size_t num = stages.Length();
+    std::vector<std::shared_ptr<Process> > procs;
+    std::vector<std::vector<ProcessRedirection> > redirs;
+    procs.reserve(num);
+    redirs.reserve(num);
+    for (size_t i = 0; i < num; ++i) {
+        const auto stagev = stages.Get(i);
+        if (!stagev.IsObject()) {
+            throw Napi::TypeError::New(env, "Stage needs to be an object");
+        }
+        const auto stage = stagev.As<Napi::Object>();
+        const auto cmd = stage.Get("cmd");
+        if (!cmd.IsString()) {
+            throw Napi::TypeError::New(env, "Stage cmd needs to be a string");
+        }
+        const auto callback = stage.Get("callback");
+        if (!callback.IsFunction()) {
+            throw Napi::TypeError::New(env, "Stage callback needs to be a function");
+        }
+
+        auto proc = std::make_shared<Process>();
+        proc->cmd = cmd.As<Napi::String>().Utf8Value();
+        proc->args = parseArgs(stage.Get("args"));
+        proc->env = parseEnv(stage.Get("env"));
+        proc->callback = std::make_unique<AsyncFunction>(Napi::Persistent(callback.As<Napi::Function>()), Napi::AsyncContext(env, "process"));
+        procs.push_back(std::move(proc));
+        redirs.push_back(parseRedirections(stage.Get("redirs")));
+    }
+    const ProcessOptions base = parseOptions(env, info[1].As<Napi::Object>());
+
+    // every stage after the first reads the previous stage's stdout
+    // directly and joins the process group of the first one that launched
+    auto result = Napi::Array::New(env, num);
+    std::shared_ptr<BufferEmitter> previous = base.stdinFrom;
+    pid_t pgid = base.pgid;
+    for (size_t i = 0; i < num; ++i) {
+        const bool last = i + 1 == num;
+        ProcessOptions opts = base;
+        opts.redirectStdin = i == 0 ? base.redirectStdin : false;
+        opts.stdinFrom = previous;
+        opts.redirectStdout = last ? base.redirectStdout : true;
+        opts.pgid = pgid;
+        opts.foreground = base.foreground && (i == 0 || pgid <= 0);
+
+        // the previous stage failed to launch, give this one an empty stdin
+        const bool emptyStdin = i > 0 && !previous;
+        if (emptyStdin) {
+            opts.redirectStdin = true;
+        }
+
+        auto proc = procs[i];
+        auto obj = launchProcess(env, proc, opts, redirs[i]);
+        if (proc) {
+            if (pgid <= 0) {
+                pgid = proc->pgid;
+            }
+            if (emptyStdin) {
+                MutexLocker locker(&reader.mutex);
+                proc->pendingClose = true;
+                queueWrite(proc);
+                obj.Delete("stdinCtx");
+            }
+            previous = last ? nullptr : proc->emitStdout;
+            if (!last) {
+                // handed to the next stage
+                obj.Delete("stdoutCtx");
+            }
+        } else {
+            previous.reset();
+        }
+        result.Set(i, obj);
+    }
+
+    int e;
+    char c = 'w';
+    EINTRWRAP(e, ::write(reader.wakeuppipe[1], &c, 1));
+
+    return result;
 }
 
 Napi::Value Uid(const Napi::CallbackInfo& info)
@@ -1140,13 +2128,359 @@ Napi::Value Gids(const Napi::CallbackInfo& info)
     return gs;
 }
 
+static PathIndex pathIndex;
+
+// lookups that have to wait for the index to be rebuilt, js thread only
+struct PathQuery
+{
+    PathQuery(Napi::Promise::Deferred&& d)
+        : deferred(std::move(d))
+    {
+    }
+    Napi::Promise::Deferred deferred;
+    std::string cmd;
+    bool list { false };
+    uint64_t since { 0 };
+};
+
+static struct {
+    uv_work_t req;
+    bool building { false };
+    std::vector<std::unique_ptr<PathQuery> > pending;
+} pathQueries;
+
+static Napi::Value answerPathQuery(const Napi::Env& env, const PathQuery& query)
+{
+    if (query.list) {
+        Napi::Object ret = Napi::Object::New(env);
+        const uint64_t generation = pathIndex.generation();
+        ret.Set("generation", Napi::Number::New(env, static_cast<double>(generation)));
+        if (generation != query.since) {
+            const auto names = pathIndex.names();
+            Napi::Array array = Napi::Array::New(env, names.size());
+            for (size_t i = 0; i < names.size(); ++i) {
+                array.Set(i, Napi::String::New(env, names[i]));
+            }
+            ret.Set("names", array);
+        }
+        return ret;
+    }
+    std::string path;
+    if (pathIndex.lookup(query.cmd, path))
+        return Napi::String::New(env, path);
+    return env.Undefined();
+}
+
+static Napi::Value queuePathQuery(const Napi::Env& env, const std::string& path, std::unique_ptr<PathQuery>&& query)
+{
+    auto promise = query->deferred.Promise();
+
+    pathIndex.setPath(path);
+    if (!pathIndex.refresh()) {
+        query->deferred.Resolve(answerPathQuery(env, *query));
+        return promise;
+    }
+
+    // lookups that come in while we're rebuilding wait for that one
+    pathQueries.pending.push_back(std::move(query));
+    if (!pathQueries.building) {
+        pathQueries.building = true;
+        uv_queue_work(uv_default_loop(), &pathQueries.req,
+                      [](uv_work_t*) {
+                          // directories that keep changing while we scan get a few more tries
+                          int rounds = 0;
+                          do {
+                              pathIndex.rebuild();
+                          } while (++rounds < 3 && pathIndex.refresh());
+                      },
+                      [](uv_work_t*, int) {
+                          std::vector<std::unique_ptr<PathQuery> > pending;
+                          std::swap(pending, pathQueries.pending);
+                          pathQueries.building = false;
+                          for (const auto& query : pending) {
+                              auto env = query->deferred.Env();
+                              Napi::HandleScope scope(env);
+                              query->deferred.Resolve(answerPathQuery(env, *query));
+                          }
+                      });
+    }
+    return promise;
+}
+
+Napi::Value PathLookup(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+    if (!info[1].IsString()) {
+        throw Napi::TypeError::New(env, "Second argument needs to be a string");
+    }
+
+    auto query = std::make_unique<PathQuery>(Napi::Promise::Deferred::New(env));
+    query->cmd = info[1].As<Napi::String>().Utf8Value();
+    return queuePathQuery(env, info[0].As<Napi::String>().Utf8Value(), std::move(query));
+}
+
+Napi::Value PathExecutables(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+    if (!info[1].IsNumber() && !info[1].IsUndefined()) {
+        throw Napi::TypeError::New(env, "Second argument needs to be a number or undefined");
+    }
+
+    auto query = std::make_unique<PathQuery>(Napi::Promise::Deferred::New(env));
+    query->list = true;
+    if (info[1].IsNumber())
+        query->since = info[1].As<Napi::Number>().Int64Value();
+    return queuePathQuery(env, info[0].As<Napi::String>().Utf8Value(), std::move(query));
+}
+
+static DirCache dirCache;
+
+struct ScanDirWork
+{
+    ScanDirWork(Napi::Promise::Deferred&& d)
+        : deferred(std::move(d))
+    {
+    }
+    uv_work_t req;
+    Napi::Promise::Deferred deferred;
+    std::string path, prefix;
+    DirScanner::Filter filter { DirScanner::FilterNone };
+    std::vector<std::string> entries;
+    int error { 0 };
+};
+
+Napi::Value ScanDir(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+    if (!info[1].IsString()) {
+        throw Napi::TypeError::New(env, "Second argument needs to be a string");
+    }
+    if (!info[2].IsString() && !info[2].IsUndefined()) {
+        throw Napi::TypeError::New(env, "Third argument needs to be a string or undefined");
+    }
+
+    auto work = std::make_unique<ScanDirWork>(Napi::Promise::Deferred::New(env));
+    work->path = info[0].As<Napi::String>().Utf8Value();
+    work->prefix = info[1].As<Napi::String>().Utf8Value();
+    if (info[2].IsString()) {
+        const std::string filter = info[2].As<Napi::String>().Utf8Value();
+        if (filter == "executableOrDirectory") {
+            work->filter = DirScanner::FilterExecutableOrDirectory;
+        } else {
+            throw Napi::TypeError::New(env, "Unknown filter");
+        }
+    }
+
+    auto promise = work->deferred.Promise();
+    work->req.data = work.get();
+    uv_queue_work(uv_default_loop(), &work->req,
+                  [](uv_work_t* req) {
+                      auto work = static_cast<ScanDirWork*>(req->data);
+                      work->error = dirCache.query(work->path, work->prefix, work->filter, work->entries);
+                  },
+                  [](uv_work_t* req, int) {
+                      std::unique_ptr<ScanDirWork> work(static_cast<ScanDirWork*>(req->data));
+                      auto env = work->deferred.Env();
+                      Napi::HandleScope scope(env);
+                      if (work->error != 0) {
+                          work->deferred.Reject(Napi::Error::New(env, work->path + ": " + strerror(work->error)).Value());
+                          return;
+                      }
+                      Napi::Array entries = Napi::Array::New(env, work->entries.size());
+                      for (size_t i = 0; i < work->entries.size(); ++i) {
+                          entries.Set(i, Napi::String::New(env, work->entries[i]));
+                      }
+                      work->deferred.Resolve(entries);
+                  });
+    work.release();
+    return promise;
+}
+
+Napi::Value ScanDirStats(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    const auto stats = dirCache.stats();
+    Napi::Object ret = Napi::Object::New(env);
+    ret.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+    ret.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+    ret.Set("evictions", Napi::Number::New(env, static_cast<double>(stats.evictions)));
+    ret.Set("narrowed", Napi::Number::New(env, static_cast<double>(stats.narrowed)));
+    ret.Set("dirs", Napi::Number::New(env, static_cast<double>(stats.dirs)));
+    ret.Set("entries", Napi::Number::New(env, static_cast<double>(stats.entries)));
+    return ret;
+}
+
+void SetBatching(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsObject()) {
+        throw Napi::TypeError::New(env, "First argument needs to be an object");
+    }
+
+    auto obj = info[0].As<Napi::Object>();
+    if (obj.Has("maxBytes")) {
+        auto v = obj.Get("maxBytes");
+        if (!v.IsNumber() || v.As<Napi::Number>().Int64Value() < 1) {
+            throw Napi::TypeError::New(env, "maxBytes needs to be a positive number");
+        }
+        reader.batchBytes = v.As<Napi::Number>().Uint32Value();
+    }
+    if (obj.Has("maxLatency")) {
+        auto v = obj.Get("maxLatency");
+        if (!v.IsNumber() || v.As<Napi::Number>().Int64Value() < 0) {
+            throw Napi::TypeError::New(env, "maxLatency needs to be a number >= 0");
+        }
+        reader.batchLatency = v.As<Napi::Number>().Uint32Value();
+    }
+}
+
+static Napi::Object bufferPoolStats(const Napi::Env& env)
+{
+    Napi::Object stats = Napi::Object::New(env);
+    stats.Set("hits", Napi::Number::New(env, static_cast<double>(bufferPool.hits())));
+    stats.Set("misses", Napi::Number::New(env, static_cast<double>(bufferPool.misses())));
+    stats.Set("free", Napi::Number::New(env, static_cast<double>(bufferPool.free())));
+    stats.Set("bufferSize", Napi::Number::New(env, BufferPool::BufferSize));
+    return stats;
+}
+
+Napi::Value BufferPoolStats(const Napi::CallbackInfo& info)
+{
+    return bufferPoolStats(info.Env());
+}
+
+Napi::Value Stats(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    const bool reset = info[0].IsBoolean() && info[0].As<Napi::Boolean>().Value();
+
+    auto number = [&env](uint64_t value) {
+        return Napi::Number::New(env, static_cast<double>(value));
+    };
+
+    Napi::Object stats = Napi::Object::New(env);
+    stats.Set("wakeups", number(counters.wakeups.value()));
+    stats.Set("events", number(counters.events.value()));
+    stats.Set("timeouts", number(counters.timeouts.value()));
+    stats.Set("reads", number(counters.reads.value()));
+    stats.Set("bytesRead", number(counters.bytesRead.value()));
+    stats.Set("throttled", number(counters.throttled.value()));
+    stats.Set("writes", number(counters.writes.value()));
+    stats.Set("bytesWritten", number(counters.bytesWritten.value()));
+    stats.Set("writesBlocked", number(counters.writesBlocked.value()));
+    stats.Set("asyncSends", number(counters.asyncSends.value()));
+    stats.Set("asyncCallbacks", number(counters.asyncCallbacks.value()));
+    stats.Set("sigchlds", number(counters.sigchlds.value()));
+    stats.Set("reaps", number(counters.reaps.value()));
+    stats.Set("stops", number(counters.stops.value()));
+    stats.Set("launches", number(counters.launches.value()));
+    stats.Set("launchFailures", number(counters.launchFailures.value()));
+    stats.Set("queueDepthPeak", number(counters.queueDepth.value()));
+    stats.Set("pendingEmittersPeak", number(counters.pendingEmitters.value()));
+
+    const Histogram& latency = counters.launchLatency;
+    Napi::Object launch = Napi::Object::New(env);
+    launch.Set("count", number(latency.count()));
+    launch.Set("meanUs", Napi::Number::New(env, latency.count() ? static_cast<double>(latency.sum()) / latency.count() : 0.));
+    launch.Set("p50Us", number(latency.percentile(0.5)));
+    launch.Set("p99Us", number(latency.percentile(0.99)));
+    // trailing empty buckets left out
+    size_t used = Histogram::Buckets;
+    while (used > 0 && !latency.bucket(used - 1))
+        --used;
+    Napi::Array buckets = Napi::Array::New(env, used);
+    for (size_t i = 0; i < used; ++i) {
+        buckets.Set(i, number(latency.bucket(i)));
+    }
+    launch.Set("buckets", buckets);
+    stats.Set("launchLatency", launch);
+
+    stats.Set("bufferPool", bufferPoolStats(env));
+
+    std::vector<std::shared_ptr<Process> > live;
+    {
+        MutexLocker locker(&reader.mutex);
+        live.reserve(reader.live.size());
+        for (auto it = reader.live.begin(); it != reader.live.end(); ) {
+            if (auto proc = it->second.lock()) {
+                live.push_back(std::move(proc));
+                ++it;
+            } else {
+                it = reader.live.erase(it);
+            }
+        }
+    }
+    Napi::Array procs = Napi::Array::New(env, live.size());
+    for (size_t i = 0; i < live.size(); ++i) {
+        const auto& proc = live[i];
+        Napi::Object p = Napi::Object::New(env);
+        p.Set("pid", Napi::Number::New(env, proc->pid));
+        p.Set("cmd", Napi::String::New(env, proc->cmd));
+        if (proc->emitStdout)
+            p.Set("stdoutBytes", number(proc->emitStdout->bytesRead.value()));
+        if (proc->emitStderr)
+            p.Set("stderrBytes", number(proc->emitStderr->bytesRead.value()));
+        if (proc->writer)
+            p.Set("stdinBytes", number(proc->bytesWritten.value()));
+        procs.Set(i, p);
+    }
+    stats.Set("processes", procs);
+
+    if (reset) {
+        counters.wakeups.reset();
+        counters.events.reset();
+        counters.timeouts.reset();
+        counters.reads.reset();
+        counters.bytesRead.reset();
+        counters.throttled.reset();
+        counters.writes.reset();
+        counters.bytesWritten.reset();
+        counters.writesBlocked.reset();
+        counters.asyncSends.reset();
+        counters.asyncCallbacks.reset();
+        counters.sigchlds.reset();
+        counters.reaps.reset();
+        counters.stops.reset();
+        counters.launches.reset();
+        counters.launchFailures.reset();
+        counters.queueDepth.reset();
+        counters.pendingEmitters.reset();
+        counters.launchLatency.reset();
+    }
+
+    return stats;
+}
+
 Napi::Object Setup(Napi::Env env, Napi::Object exports)
 {
     exports.Set("start", Napi::Function::New(env, Start));
     exports.Set("stop", Napi::Function::New(env, Stop));
     exports.Set("launch", Napi::Function::New(env, Launch));
+    exports.Set("launchPipeline", Napi::Function::New(env, LaunchPipeline));
     exports.Set("uid", Napi::Function::New(env, Uid));
     exports.Set("gids", Napi::Function::New(env, Gids));
+    exports.Set("pathLookup", Napi::Function::New(env, PathLookup));
+    exports.Set("pathExecutables", Napi::Function::New(env, PathExecutables));
+    exports.Set("scanDir", Napi::Function::New(env, ScanDir));
+    exports.Set("scanDirStats", Napi::Function::New(env, ScanDirStats));
+    exports.Set("setBatching", Napi::Function::New(env, SetBatching));
+    exports.Set("bufferPoolStats", Napi::Function::New(env, BufferPoolStats));
+    exports.Set("stats", Napi::Function::New(env, Stats));
     return exports;
 }
 
@@ -1,10 +1,17 @@
+#include "HistorySearch.h"
+#include "HistoryStore.h"
+#include "QuoteTable.h"
 #include "Redirector.h"
+#include "Tracer.h"
 #include "utils.h"
 #include <assert.h>
+#include <string.h>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <napi.h>
 #include <uv.h>
+#include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -23,7 +30,10 @@ struct State
     bool pendingProcessTasks { false };
     Napi::FunctionReference callback;
     std::unique_ptr<Napi::AsyncContext> ctx;
-    std::string historyFile;
+    HistoryStore history;
+    HistorySearch historyIndex;
+    // readline thread only, toggled and dumped through tasks
+    Tracer tracer;
     std::string prompt { "jsh3> " };
 
     enum class WakeupReason { Stop, Task, Complete, Winch };
@@ -34,21 +44,56 @@ struct State
         Queue<std::string> lines;
     } readline;
 
+    // completion runs in js while the readline thread keeps going. every
+    // request gets a new generation, results for anything but the latest
+    // generation (or for a line that has changed since) are dropped
     struct {
         uv_async_t async;
+        std::atomic<uint64_t> generation { 0 };
         struct {
+            uint64_t generation;
             std::string buffer;
             std::string text;
             int start, end;
         } pending;
         std::vector<std::string> results;
-        bool inComplete { false };
+        uint64_t resultsGeneration { 0 };
         Mutex mutex;
+
+        // readline thread only
+        std::string line;
+        int point { 0 };
+        int what { '\t' };
+        bool upgraded { false };
+        bool waiting { false };
+        bool requesting { false };
+        bool delivering { false };
+        std::vector<std::string> matches;
+        // the line as the last delivery left it, a second tab on
+        // an unchanged line lists the matches like readline does
+        std::string settledLine;
+        int settledPoint { -1 };
     } completion;
 
     static void run(void* arg);
     static void lineHandler(char* line);
     static char** completer(const char* text, int start, int end);
+    static int requestCompletion(int count, int key);
+    static void deliverCompletion();
+
+    // cycling through history search results, the line the search
+    // started from is the last stop before wrapping around
+    struct {
+        std::vector<std::string> matches;
+        std::string original;
+        long index { 0 };
+    } search;
+
+    // cleared whenever the line may have changed, see char_is_quoted()
+    QuoteTable quotes;
+
+    static int searchHistory(int count, int key);
+    static void redisplay();
     static void forcePrompt(const std::string& prompt);
 
     void readlineInit();
@@ -61,6 +106,29 @@ struct State
     void saveState();
     void restoreState();
 
+    // redirected output is held back and written once per frame, so the
+    // prompt comes down and goes back up once for all of it rather than
+    // once for every read. the first output after a quiet frame goes out
+    // right away
+    struct Output
+    {
+        enum { DefaultFrameRate = 60, ChunkSize = 16384, MaxPending = 1024 * 1024 };
+        struct Chunk
+        {
+            bool toStderr;
+            std::string data;
+        };
+        std::vector<Chunk> chunks;
+        size_t pending { 0 };
+        uint64_t lastFrame { 0 };
+        // ns, 0 writes whatever was read right away
+        uint64_t interval { 1000000000 / DefaultFrameRate };
+    } output;
+
+    // ns until the next frame is due, only meaningful with output pending
+    uint64_t nextFrame() const;
+    void flushOutput();
+
     struct AsyncPromise
     {
         AsyncPromise(Napi::Promise::Deferred&& d, Napi::AsyncContext&& c)
@@ -95,89 +163,22 @@ struct State
 
 static State state;
 
-// handle utf-8
-#define ADVANCE_CHAR(_str, _strsize, _i)        \
-    do {                                        \
-        if (_i + 1 <= _strsize) {               \
-            if (_str[++_i] & 0x10000000)        \
-                continue;                       \
-        } else if (_i == _strsize) {            \
-            ++_i;                               \
-        }                                       \
-    }                                           \
-    while (0)
-
-// ugh, maybe we should delegate this to js?
-// also, how many times have I written this code now?
+// readline asks about every candidate word break while looking for the
+// word to complete, the table is built once per change to the line
 int char_is_quoted(char* string, int eindex)
 {
-    enum State {
-        Normal,
-        Double,
-        Single,
-        Escape
-    };
-    bool wasEscaped = false;
-    std::vector<State> state;
-    state.push_back(Normal);
-    auto current = [&state]() {
-        return state.back();
-    };
-    auto maybePop = [&state](State s) {
-        if (state.back() == s) {
-            state.pop_back();
-            return true;
-        }
-        return false;
-    };
-    for (int i = 0; i <= eindex;) {
-        wasEscaped = current() == Escape;
-        switch (string[i]) {
-        case '\\':
-            switch (current()) {
-            case Escape:
-                state.pop_back();
-                break;
-            default:
-                state.push_back(Escape);
-                break;
-            }
-            break;
-        case '"':
-            switch (current()) {
-            case Normal:
-                state.push_back(Double);
-                break;
-            case Double:
-                state.pop_back();
-                break;
-            default:
-                break;
-            }
-            maybePop(Escape);
-            break;
-        case '\'':
-            switch (current()) {
-            case Normal:
-                state.push_back(Single);
-                break;
-            case Single:
-                state.pop_back();
-                break;
-            default:
-                break;
-            }
-            maybePop(Escape);
-            break;
-        default:
-            maybePop(Escape);
-            break;
-        }
-
-        ADVANCE_CHAR(string, eindex, i);
+    auto& quotes = state.quotes;
+    if (string != rl_line_buffer) {
+        QuoteTable table;
+        table.build(string, strlen(string));
+        return table.quoted(eindex);
     }
-    //printf("got state %d for %d (%c - '%s')\n", eindex, string[eindex], string);
-    return (!wasEscaped && current() == Normal) ? 0 : 1;
+    if (!quotes.valid(string, rl_end)) {
+        TraceScope trace(state.tracer, "quote table", "chars");
+        trace.setArg(rl_end);
+        quotes.build(string, rl_end);
+    }
+    return quotes.quoted(eindex);
 }
 
 void State::saveState()
@@ -203,12 +204,56 @@ void State::restoreState()
     state.savedLine = 0;
 }
 
-static void handleOut(int fd, const std::function<void(const char*, int)>& write)
+uint64_t State::nextFrame() const
+{
+    const uint64_t now = uv_hrtime();
+    if (output.pending >= output.MaxPending || now - output.lastFrame >= output.interval)
+        return 0;
+    return output.lastFrame + output.interval - now;
+}
+
+void State::flushOutput()
+{
+    auto& output = state.output;
+    if (output.chunks.empty())
+        return;
+
+    TraceScope trace(state.tracer, "frame", "bytes");
+    trace.setArg(output.pending);
+
+    state.saveState();
+    // one writev for each run of the same stream, stdout and stderr
+    // still come out in the order they were read
+    std::vector<struct iovec> iov;
+    size_t idx = 0;
+    while (idx < output.chunks.size()) {
+        const bool toStderr = output.chunks[idx].toStderr;
+        iov.clear();
+        while (idx < output.chunks.size() && output.chunks[idx].toStderr == toStderr && iov.size() < IOV_MAX) {
+            auto& data = output.chunks[idx++].data;
+            iov.push_back({ &data[0], data.size() });
+        }
+        if (toStderr) {
+            state.redirector.writeStderr(iov.data(), iov.size());
+        } else {
+            state.redirector.writeStdout(iov.data(), iov.size());
+        }
+    }
+    state.restoreState();
+
+    output.chunks.clear();
+    output.pending = 0;
+    output.lastFrame = uv_hrtime();
+}
+
+// returns the number of bytes read, they go out with the next frame
+static size_t handleOut(int fd, bool toStderr)
 {
-    bool saved = false;
+    auto& output = state.output;
+    size_t total = 0;
 
     // read until the end of time
-    char buf[16384];
+    char buf[State::Output::ChunkSize];
     for (;;) {
         const ssize_t r = read(fd, buf, sizeof(buf));
         if (r == -1) {
@@ -217,22 +262,25 @@ static void handleOut(int fd, const std::function<void(const char*, int)>& write
             if (errno == EINTR)
                 continue;
             // badness!
-            return;
+            return total;
         } else if (!r) {
             // done?
             break;
         } else {
-            if (!saved) {
-                state.saveState();
-                saved = true;
+            // small reads pile up in the last chunk
+            if (output.chunks.empty()
+                || output.chunks.back().toStderr != toStderr
+                || output.chunks.back().data.size() + r > State::Output::ChunkSize) {
+                output.chunks.push_back({ toStderr, std::string() });
+                output.chunks.back().data.reserve(State::Output::ChunkSize);
             }
-            write(buf, r);
+            output.chunks.back().data.append(buf, r);
+            output.pending += r;
+            total += r;
         }
     }
 
-    if (saved) {
-        state.restoreState();
-    }
+    return total;
 }
 
 void State::wakeup(WakeupReason reason)
@@ -257,12 +305,7 @@ void State::lineHandler(char* line)
 
 char** State::completer(const char* text, int start, int end)
 {
-    {
-        MutexLocker locker(&state.completion.mutex);
-        state.completion.inComplete = true;
-        state.completion.pending = { std::string(rl_line_buffer), std::string(text), start, end };
-        uv_async_send(&state.completion.async);
-    }
+    auto& completion = state.completion;
 
     // ### if we want file completion, just return nullptr before setting this variable
     rl_attempted_completion_over = 1;
@@ -271,59 +314,138 @@ char** State::completer(const char* text, int start, int end)
     rl_completion_suppress_append = 1;
     rl_completion_suppress_quote = 1;
 
-    const int max = state.wakeupPipe[0];
-    fd_set rdset;
-    for (;;) {
-        FD_ZERO(&rdset);
-        FD_SET(state.wakeupPipe[0], &rdset);
-
-        int r = select(max + 1, &rdset, 0, 0, 0);
-        if (r <= 0) {
-            // boo
+    if (completion.delivering) {
+        if (completion.matches.empty())
             return nullptr;
+        // already sorted and deduplicated by Complete()
+        rl_sort_completion_matches = 0;
+        rl_ignore_completion_duplicates = 0;
+        char** array = static_cast<char**>(malloc((1 + completion.matches.size()) * sizeof(*array)));
+        size_t ptr = 0;
+        for (const auto& m : completion.matches) {
+            array[ptr++] = strdup(m.c_str());
         }
+        array[ptr] = nullptr;
+        return array;
+    }
 
-        if (FD_ISSET(state.wakeupPipe[0], &rdset)) {
-            char c;
-            for (;;) {
-                EINTRWRAP(r, read(state.wakeupPipe[0], &c, 1));
-                if (r == -1)
-                    break;
-                if (r == 1) {
-                    const WakeupReason reason = static_cast<WakeupReason>(c);
-                    switch (reason) {
-                    case WakeupReason::Stop:
-                        state.stopped = true;
-                        break;
-                    case WakeupReason::Task:
-                        state.pendingProcessTasks = true;
-                        break;
-                    case WakeupReason::Complete: {
-                        MutexLocker locker(&state.completion.mutex);
-                        assert(!state.completion.inComplete);
-                        if (!state.completion.results.empty()) {
-                            char** array = static_cast<char**>(malloc((1 + state.completion.results.size()) * sizeof(*array)));
-                            // array[0] = strdup(longest_common_prefix(text, state.completion.results).c_str());
-                            size_t ptr = 0;
-                            for (const auto& m : state.completion.results) {
-                                array[ptr++] = strdup(m.c_str());
-                            }
-                            array[ptr] = nullptr;
-                            return array;
-                        }
-                        return nullptr; }
-                    case WakeupReason::Winch:
-                        rl_resize_terminal();
-                        break;
-                    }
-                }
-            }
-        }
+    if (!completion.requesting) {
+        // not our tab binding, possible-completions or similar
+        completion.line.assign(rl_line_buffer, rl_end);
+        completion.point = rl_point;
+        completion.what = rl_completion_type == '%' ? '\t' : rl_completion_type;
+    }
+    completion.waiting = true;
+    {
+        MutexLocker locker(&completion.mutex);
+        completion.pending = { ++completion.generation, std::string(rl_line_buffer), std::string(text), start, end };
     }
+    uv_async_send(&completion.async);
 
+    // the matches show up later through deliverCompletion()
     return nullptr;
 }
 
+int State::requestCompletion(int count, int key)
+{
+    auto& completion = state.completion;
+    const std::string line(rl_line_buffer, rl_end);
+    const bool again = rl_last_func == requestCompletion;
+
+    if (completion.waiting && line == completion.line && rl_point == completion.point) {
+        // the previous request is still on its way
+        if (again)
+            completion.upgraded = true;
+        return 0;
+    }
+
+    TraceScope trace(state.tracer, "completion request");
+    completion.line = line;
+    completion.point = rl_point;
+    completion.what = again && line == completion.settledLine && rl_point == completion.settledPoint ? '?' : '\t';
+    completion.upgraded = false;
+
+    // let readline find the word to complete, completer() posts it. it
+    // comes back empty handed for now so keep readline from ringing the bell
+    const char* bell = rl_variable_value("bell-style");
+    const std::string savedBell = bell ? bell : "audible";
+    rl_variable_bind("bell-style", "none");
+    completion.requesting = true;
+    state.quotes.clear();
+    rl_complete_internal('\t');
+    completion.requesting = false;
+    rl_variable_bind("bell-style", savedBell.c_str());
+    return 0;
+}
+
+void State::deliverCompletion()
+{
+    TraceScope trace(state.tracer, "completion");
+    auto& completion = state.completion;
+    {
+        MutexLocker locker(&completion.mutex);
+        if (!completion.waiting || completion.resultsGeneration != completion.generation)
+            return;
+        completion.matches = std::move(completion.results);
+        completion.results.clear();
+    }
+    completion.waiting = false;
+
+    if (state.paused
+        || rl_point != completion.point
+        || completion.line.compare(0, std::string::npos, rl_line_buffer, rl_end) != 0) {
+        // stale, the line has moved on since we asked
+        completion.matches.clear();
+        return;
+    }
+
+    completion.delivering = true;
+    state.quotes.clear();
+    rl_complete_internal(completion.what);
+    if (completion.upgraded && rl_point == completion.point
+        && completion.line.compare(0, std::string::npos, rl_line_buffer, rl_end) == 0) {
+        // tab was pressed twice while waiting and there was nothing to insert
+        rl_complete_internal('?');
+    }
+    completion.delivering = false;
+    completion.matches.clear();
+
+    completion.settledLine.assign(rl_line_buffer, rl_end);
+    completion.settledPoint = rl_point;
+    rl_redisplay();
+}
+
+int State::searchHistory(int count, int key)
+{
+    auto& search = state.search;
+    if (rl_last_func != searchHistory) {
+        search.original.assign(rl_line_buffer, rl_end);
+        search.matches = state.historyIndex.search(search.original);
+        search.index = count > 0 ? count - 1 : count;
+    } else {
+        search.index += count;
+    }
+    if (search.matches.empty()) {
+        rl_ding();
+        return 0;
+    }
+
+    const long stops = static_cast<long>(search.matches.size()) + 1;
+    search.index = ((search.index % stops) + stops) % stops;
+    const std::string& line = search.index < stops - 1 ? search.matches[search.index] : search.original;
+    rl_replace_line(line.c_str(), 0);
+    rl_point = rl_end;
+    return 0;
+}
+
+void State::redisplay()
+{
+    TraceScope trace(state.tracer, "redisplay");
+    // anything that edits the line redisplays afterwards
+    state.quotes.clear();
+    rl_redisplay();
+}
+
 void State::forcePrompt(const std::string& prompt)
 {
     // there really must be a better way of doing this. right? right?
@@ -364,6 +486,7 @@ void State::run(void*)
         for (;;) {
             if (!state.tasks.queries.pop(query))
                 break;
+            TraceScope trace(state.tracer, "task");
             const auto ret = query.task(query.argument);
             state.tasks.replies.push({ std::move(query.promise), true, std::move(ret) });
             uv_async_send(&state.tasks.async);
@@ -382,17 +505,18 @@ void State::run(void*)
     rl_completer_quote_characters = "'\"";
 
     rl_attempted_completion_function = completer;
+    rl_redisplay_function = redisplay;
 
     state.readlineInit();
+    rl_add_defun("jsh-complete", requestCompletion, '\t');
+    rl_add_defun("jsh-history-search", searchHistory, -1);
+    rl_bind_keyseq("\\es", searchHistory);
 
     fd_set rdset;
 
     const int stdoutfd = state.redirector.stdout();
     const int stderrfd = state.redirector.stderr();
 
-    const auto stdoutfunc = std::bind(&Redirector::writeStdout, &state.redirector, std::placeholders::_1, std::placeholders::_2);
-    const auto stderrfunc = std::bind(&Redirector::writeStderr, &state.redirector, std::placeholders::_1, std::placeholders::_2);
-
     int max = STDIN_FILENO;
     if (state.wakeupPipe[0] > max)
         max = state.wakeupPipe[0];
@@ -410,8 +534,18 @@ void State::run(void*)
         }
         FD_SET(state.wakeupPipe[0], &rdset);
 
-        int r = select(max + 1, &rdset, 0, 0, 0);
-        if (r <= 0) {
+        // wake up in time for the frame if there's output waiting for one
+        struct timeval timeout;
+        struct timeval* timeoutp = nullptr;
+        if (!state.output.chunks.empty()) {
+            const uint64_t wait = state.nextFrame();
+            timeout.tv_sec = wait / 1000000000;
+            timeout.tv_usec = (wait % 1000000000) / 1000;
+            timeoutp = &timeout;
+        }
+
+        int r = select(max + 1, &rdset, 0, 0, timeoutp);
+        if (r < 0) {
             // boo
             break;
         }
@@ -419,11 +553,14 @@ void State::run(void*)
         if (FD_ISSET(state.wakeupPipe[0], &rdset)) {
             char c;
             for (;;) {
-                EINTRWRAP(r, read(state.wakeupPipe[0], &c, 1));
-                if (r == -1)
+                ssize_t n;
+                EINTRWRAP(n, read(state.wakeupPipe[0], &c, 1));
+                if (n == -1)
                     break;
-                if (r == 1) {
+                if (n == 1) {
                     const WakeupReason reason = static_cast<WakeupReason>(c);
+                    TraceScope trace(state.tracer, "wakeup", "reason");
+                    trace.setArg(c);
                     switch (reason) {
                     case WakeupReason::Stop:
                         state.stopped = true;
@@ -432,6 +569,7 @@ void State::run(void*)
                         processTasks();
                         break;
                     case WakeupReason::Complete:
+                        deliverCompletion();
                         break;
                     case WakeupReason::Winch:
                         rl_resize_terminal();
@@ -442,21 +580,28 @@ void State::run(void*)
         }
         if (!state.paused) {
             if (FD_ISSET(stdoutfd, &rdset)) {
-                handleOut(stdoutfd, stdoutfunc);
+                TraceScope trace(state.tracer, "stdout", "bytes");
+                trace.setArg(handleOut(stdoutfd, false));
             }
             if (FD_ISSET(stderrfd, &rdset)) {
-                handleOut(stderrfd, stderrfunc);
+                TraceScope trace(state.tracer, "stderr", "bytes");
+                trace.setArg(handleOut(stderrfd, true));
             }
             if (FD_ISSET(STDIN_FILENO, &rdset)) {
+                // from the wakeup until readline is done with the input,
+                // covers the echo since readline redisplays as it goes
+                TraceScope trace(state.tracer, "stdin", "chars");
+                int chars = 0;
                 // read until we have nothing more to read
-                if (r == -1) {
-                    // ugh
-                    break;
-                }
                 bool error = false;
                 int rem;
                 for (;;) {
-                    rl_callback_read_char();
+                    {
+                        TraceScope trace(state.tracer, "rl_callback_read_char");
+                        state.quotes.clear();
+                        rl_callback_read_char();
+                    }
+                    ++chars;
                     // loop while we have more characters
                     if (ioctl(STDIN_FILENO, FIONREAD, &rem) == -1) {
                         // ugh
@@ -466,10 +611,21 @@ void State::run(void*)
                     if (!rem)
                         break;
                 }
+                trace.setArg(chars);
                 if (error)
                     break;
+                if (state.completion.waiting
+                    && (rl_point != state.completion.point
+                        || state.completion.line.compare(0, std::string::npos, rl_line_buffer, rl_end) != 0)) {
+                    // typing supersedes whatever completion is in flight
+                    state.completion.waiting = false;
+                    ++state.completion.generation;
+                }
             }
         }
+        if (!state.output.chunks.empty() && !state.nextFrame()) {
+            state.flushOutput();
+        }
         if (state.pendingProcessTasks) {
             state.pendingProcessTasks = false;
             processTasks();
@@ -478,6 +634,7 @@ void State::run(void*)
             break;
         }
     }
+    state.flushOutput();
     state.readlineDeinit();
 }
 
@@ -497,6 +654,26 @@ Napi::Promise State::runTask(Napi::Env& env,
     return promise;
 }
 
+// what a completion of prefix replaces it with when there's more than one
+// match, the matches are file names when prefix has a directory part
+static std::string substitution(const std::string& prefix, const std::vector<std::string>& matches)
+{
+    const size_t slash = prefix.rfind('/');
+    const size_t dir = slash == std::string::npos ? 0 : slash + 1;
+    const std::string joined = prefix.substr(0, dir) + longest_common_prefix(prefix.substr(dir), matches);
+
+    std::string ret;
+    ret.reserve(joined.size() + 1);
+    for (size_t i = 0; i < joined.size(); ++i) {
+        ret += joined[i];
+        if (joined[i] == '/' && i + 1 < joined.size() && joined[i + 1] == '/')
+            ++i;
+    }
+    if (dir && dir == prefix.size() && ret.back() != '/')
+        ret += '/';
+    return ret;
+}
+
 void Complete(const Napi::CallbackInfo& info)
 {
     auto env = info.Env();
@@ -505,26 +682,57 @@ void Complete(const Napi::CallbackInfo& info)
         throw Napi::TypeError::New(env, "First argument needs to be an array of strings or undefined");
     }
 
-    MutexLocker locker(&state.completion.mutex);
-    if (!state.completion.inComplete) {
-        throw Napi::TypeError::New(env, "Not completing");
+    const uint64_t generation = reinterpret_cast<uintptr_t>(info.Data());
+
+    if (generation != state.completion.generation) {
+        // superseded, nobody wants these anymore
+        return;
     }
-    state.completion.inComplete = false;
-    state.completion.results.clear();
 
+    std::vector<std::string> results;
     if (info[0].IsArray()) {
         const auto arr = info[0].As<Napi::Array>();
 
-        state.completion.results.reserve(arr.Length());
+        results.reserve(arr.Length());
 
         for (size_t i = 0; i < arr.Length(); ++i) {
-            state.completion.results.push_back(arr.Get(i).As<Napi::String>().Utf8Value());
+            results.push_back(arr.Get(i).As<Napi::String>().Utf8Value());
+        }
+    }
+    if (results.size() > 1) {
+        // the first one is the text the others complete, readline gets
+        // what it's replaced with followed by the matches sorted and
+        // without duplicates. done here so the readline thread never
+        // spends time on it
+        std::string prefix = std::move(results[0]);
+        results.erase(results.begin());
+        sort_unique(results);
+        std::string replacement = substitution(prefix, results);
+        if (results.size() == 1) {
+            // all the same match, readline takes it as is
+            results.clear();
         }
+        results.insert(results.begin(), std::move(replacement));
     }
 
+    MutexLocker locker(&state.completion.mutex);
+    if (generation != state.completion.generation) {
+        return;
+    }
+    state.completion.resultsGeneration = generation;
+    state.completion.results = std::move(results);
+
     state.wakeup(State::WakeupReason::Complete);
 }
 
+Napi::Value Superseded(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    const uint64_t generation = reinterpret_cast<uintptr_t>(info.Data());
+    return Napi::Boolean::New(env, generation != state.completion.generation);
+}
+
 Napi::Value Start(const Napi::CallbackInfo& info)
 {
     auto env = info.Env();
@@ -559,12 +767,7 @@ Napi::Value Start(const Napi::CallbackInfo& info)
     auto handleAsync = [](uv_async_t* async) {
         if (async == &state.readline.async) {
             std::vector<std::string> data;
-            std::string line;
-            for (;;) {
-                if (!state.readline.lines.pop(line))
-                    break;
-                data.push_back(std::move(line));
-            }
+            state.readline.lines.pop_all(data);
 
             auto env = state.ctx->Env();
 
@@ -612,11 +815,18 @@ Napi::Value Start(const Napi::CallbackInfo& info)
             Napi::Object comp = Napi::Object::New(env);
             {
                 MutexLocker locker(&state.completion.mutex);
-                comp.Set("buffer", Napi::String::New(env, state.completion.pending.buffer));
-                comp.Set("text", Napi::String::New(env, state.completion.pending.text));
-                comp.Set("start", Napi::Number::New(env, state.completion.pending.start));
-                comp.Set("end", Napi::Number::New(env, state.completion.pending.end));
-                comp.Set("complete", Napi::Function::New(env, Complete));
+                const auto& pending = state.completion.pending;
+                if (pending.generation != state.completion.generation) {
+                    // superseded before js even got to see it
+                    return;
+                }
+                void* generation = reinterpret_cast<void*>(static_cast<uintptr_t>(pending.generation));
+                comp.Set("buffer", Napi::String::New(env, pending.buffer));
+                comp.Set("text", Napi::String::New(env, pending.text));
+                comp.Set("start", Napi::Number::New(env, pending.start));
+                comp.Set("end", Napi::Number::New(env, pending.end));
+                comp.Set("complete", Napi::Function::New(env, Complete, "complete", generation));
+                comp.Set("superseded", Napi::Function::New(env, Superseded, "superseded", generation));
             }
             obj.Set("type", "completion");
             obj.Set("completion", comp);
@@ -658,6 +868,8 @@ Napi::Value Pause(const Napi::CallbackInfo& info)
                          [](const Variant& arg) -> Variant {
                              if (state.paused)
                                  return Undefined;
+                             // whatever output was held back goes out first
+                             state.flushOutput();
                              state.paused = true;
                              rl_set_prompt("");
                              rl_replace_line("", 0);
@@ -676,6 +888,8 @@ Napi::Value Quiet(const Napi::CallbackInfo& info)
                          [](const Variant& arg) -> Variant {
                              if (state.paused)
                                  return Undefined;
+                             // whatever output was held back goes out first
+                             state.flushOutput();
                              state.paused = true;
                              rl_set_prompt("");
                              rl_replace_line("", 0);
@@ -743,6 +957,21 @@ Napi::Value SetPrompt(const Napi::CallbackInfo& info)
                          });
 }
 
+// drops the most recent copy of line from readline's list, duplicates
+// tend to be recent so search from the end
+static void removeHistory(const std::string& line)
+{
+    HIST_ENTRY** list = history_list();
+    if (!list)
+        return;
+    for (int i = history_length - 1; i >= 0; --i) {
+        if (!strcmp(list[i]->line, line.c_str())) {
+            free_history_entry(remove_history(i));
+            return;
+        }
+    }
+}
+
 Napi::Value AddHistory(const Napi::CallbackInfo& info)
 {
     auto env = info.Env();
@@ -755,19 +984,33 @@ Napi::Value AddHistory(const Napi::CallbackInfo& info)
     return state.runTask(env, info[0],
                          [write](const Variant& arg) -> Variant {
                              if (auto nstr = std::get_if<std::string>(&arg)) {
-                                 auto cur = current_history();
-                                 if (!cur) {
-                                     // last one?
-                                     cur = history_get(history_base + history_length - 1);
-                                 }
-                                 if (cur) {
-                                     if (!strcmp(nstr->c_str(), cur->line))
-                                         return Undefined;
+                                 // a line that didn't make it to the file
+                                 // still goes into this shell's history
+                                 const HistoryStore::AddResult added = write && state.history.isOpen()
+                                     ? state.history.add(*nstr) : HistoryStore::Failed;
+                                 switch (added) {
+                                 case HistoryStore::Unchanged:
+                                     return Undefined;
+                                 case HistoryStore::Moved:
+                                     removeHistory(*nstr);
+                                     break;
+                                 case HistoryStore::Added:
+                                     break;
+                                 case HistoryStore::Failed: {
+                                     auto cur = current_history();
+                                     if (!cur) {
+                                         // last one?
+                                         cur = history_get(history_base + history_length - 1);
+                                     }
+                                     if (cur) {
+                                         if (!strcmp(nstr->c_str(), cur->line))
+                                             return Undefined;
+                                     }
+                                     break; }
                                  }
                                  add_history(nstr->c_str());
                                  history_set_pos(history_length);
-                                 if (write && !state.historyFile.empty())
-                                     write_history(state.historyFile.c_str());
+                                 state.historyIndex.add(*nstr);
                              }
                              return Undefined;
                          });
@@ -783,16 +1026,43 @@ Napi::Value ReadHistory(const Napi::CallbackInfo& info)
 
     return state.runTask(env, info[0], [](const Variant& arg) -> Variant {
         if (auto nstr = std::get_if<std::string>(&arg)) {
-            state.historyFile = *nstr;
-            const int ret = read_history(nstr->c_str());
-            if (!ret) {
+            if (state.history.open(*nstr)) {
+                std::string line;
+                state.history.forEach([&line](std::string_view entry) {
+                    line.assign(entry.data(), entry.size());
+                    add_history(line.c_str());
+                    state.historyIndex.add(entry);
+                });
+                using_history();
+            } else if (!read_history(nstr->c_str())) {
                 using_history();
+                HIST_ENTRY** list = history_list();
+                for (int i = 0; list && i < history_length; ++i) {
+                    state.historyIndex.add(list[i]->line);
+                }
             }
         }
         return Undefined;
     });
 }
 
+Napi::Value SearchHistory(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsString()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a string");
+    }
+    const size_t limit = info[1].IsNumber() ? info[1].As<Napi::Number>().Uint32Value() : static_cast<size_t>(HistorySearch::DefaultLimit);
+
+    return state.runTask(env, info[0], [limit](const Variant& arg) -> Variant {
+        if (auto nstr = std::get_if<std::string>(&arg)) {
+            return state.historyIndex.search(*nstr, limit);
+        }
+        return Undefined;
+    });
+}
+
 Napi::Value WriteHistory(const Napi::CallbackInfo& info)
 {
     auto env = info.Env();
@@ -803,13 +1073,56 @@ Napi::Value WriteHistory(const Napi::CallbackInfo& info)
 
     return state.runTask(env, info[0], [](const Variant& arg) -> Variant {
         if (auto nstr = std::get_if<std::string>(&arg)) {
-            state.historyFile = *nstr;
             write_history(nstr->c_str());
+            // appends go to the file we just wrote from now on
+            state.history.open(*nstr);
         }
         return Undefined;
     });
 }
 
+Napi::Value SetFrameRate(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsNumber()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a number");
+    }
+    const double hz = info[0].As<Napi::Number>().DoubleValue();
+    const uint64_t interval = hz > 0 ? static_cast<uint64_t>(1000000000 / hz) : 0;
+
+    return state.runTask(env, env.Undefined(), [interval](const Variant&) -> Variant {
+        state.output.interval = interval;
+        return Undefined;
+    });
+}
+
+Napi::Value Trace(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    if (!info[0].IsBoolean()) {
+        throw Napi::TypeError::New(env, "First argument needs to be a boolean");
+    }
+    const size_t capacity = info[1].IsNumber() ? info[1].As<Napi::Number>().Uint32Value() : static_cast<size_t>(Tracer::DefaultCapacity);
+
+    return state.runTask(env, info[0], [capacity](const Variant& arg) -> Variant {
+        if (auto enabled = std::get_if<bool>(&arg)) {
+            state.tracer.setEnabled(*enabled, capacity);
+        }
+        return Undefined;
+    });
+}
+
+Napi::Value TraceDump(const Napi::CallbackInfo& info)
+{
+    auto env = info.Env();
+
+    return state.runTask(env, env.Undefined(), [](const Variant&) -> Variant {
+        return state.tracer.chromeTrace();
+    });
+}
+
 static void LogToFile(FILE* f, const Napi::CallbackInfo& info)
 {
     //auto env = info.Env();
@@ -855,6 +1168,10 @@ Napi::Object Setup(Napi::Env env, Napi::Object exports)
     exports.Set("addHistory", Napi::Function::New(env, AddHistory));
     exports.Set("readHistory", Napi::Function::New(env, ReadHistory));
     exports.Set("writeHistory", Napi::Function::New(env, WriteHistory));
+    exports.Set("searchHistory", Napi::Function::New(env, SearchHistory));
+    exports.Set("setFrameRate", Napi::Function::New(env, SetFrameRate));
+    exports.Set("trace", Napi::Function::New(env, Trace));
+    exports.Set("traceDump", Napi::Function::New(env, TraceDump));
 
     auto log = Napi::Object::New(env);
     log.Set("log", Napi::Function::New(env, Log));
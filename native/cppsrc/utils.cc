@@ -1,6 +1,48 @@
 #include "utils.h"
+#include <algorithm>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-// taken from https://github.com/eliben/code-for-blog/blob/master/2016/readline-samples/utils.cpp, public domain
+size_t common_prefix_length(const char* a, const char* b, size_t size)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= size; i += 32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const uint32_t differ = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if (differ)
+            return i + __builtin_ctz(differ);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const uint32_t differ = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xffff;
+        if (differ)
+            return i + __builtin_ctz(differ);
+    }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // a word at a time, the lowest differing bit is in the first differing byte
+    for (; i + 8 <= size; i += 8) {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i, sizeof(wa));
+        memcpy(&wb, b + i, sizeof(wb));
+        if (wa != wb)
+            return i + __builtin_ctzll(wa ^ wb) / 8;
+    }
+#endif
+    while (i < size && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+// like https://github.com/eliben/code-for-blog/blob/master/2016/readline-samples/utils.cpp, public domain.
+// the candidates only have to agree past s, each one is compared against the
+// first for no more than what they still have in common
 std::string longest_common_prefix(const std::string& s, const std::vector<std::string>& candidates)
 {
     assert(candidates.size() > 0);
@@ -8,26 +50,27 @@ std::string longest_common_prefix(const std::string& s, const std::vector<std::s
         return candidates[0];
     }
 
-    std::string prefix(s);
-    while (true) {
-        // Each iteration of this loop advances to the next location in all the
-        // candidates and sees if they match up to it.
-        size_t nextloc = prefix.size();
-        auto i = candidates.begin();
-        if (i->size() <= nextloc) {
-            return prefix;
+    const size_t base = s.size();
+    const std::string& first = candidates[0];
+    if (first.size() <= base) {
+        return s;
+    }
+    size_t common = first.size() - base;
+    for (size_t i = 1; i < candidates.size(); ++i) {
+        const std::string& candidate = candidates[i];
+        if (candidate.size() <= base) {
+            return s;
         }
-        char nextchar = (*(i++))[nextloc];
-        for (; i != candidates.end(); ++i) {
-            if (i->size() <= nextloc || (*i)[nextloc] != nextchar) {
-                // Bail out if there's a mismatch for this candidate.
-                return prefix;
-            }
+        common = common_prefix_length(first.data() + base, candidate.data() + base, std::min(common, candidate.size() - base));
+        if (!common) {
+            return s;
         }
-        // All candidates have contents[nextloc] == nextchar, so we can safely
-        // extend the prefix.
-        prefix.append(1, nextchar);
     }
+    return s + first.substr(base, common);
+}
 
-    assert(0 && "unreachable");
+void sort_unique(std::vector<std::string>& candidates)
+{
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
 }
@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "Ring.h"
 #include <uv.h>
 #include <napi.h>
 #include <assert.h>
@@ -120,11 +121,14 @@ private:
     uv_cond_t mCond;
 };
 
+// lock-free in the common case, pushes only fall back to a locked
+// overflow list while the ring is full. FIFO per producer, single consumer
 template<typename T>
 class Queue
 {
 public:
-    Queue()
+    Queue(size_t capacity = 256)
+        : mRing(capacity), mOverflowing(false)
     {
     }
 
@@ -134,38 +138,72 @@ public:
 
     void push(T&& t)
     {
+        if (!mOverflowing.load(std::memory_order_acquire) && mRing.push(std::move(t)))
+            return;
         MutexLocker locker(&mMutex);
-        mContainer.push(std::forward<T>(t));
+        mOverflow.push(std::forward<T>(t));
+        mOverflowing.store(true, std::memory_order_release);
     }
 
     void push(const T& t)
     {
+        if (!mOverflowing.load(std::memory_order_acquire) && mRing.push(t))
+            return;
         MutexLocker locker(&mMutex);
-        mContainer.push(t);
+        mOverflow.push(t);
+        mOverflowing.store(true, std::memory_order_release);
     }
 
     bool pop(T& t)
     {
+        if (mRing.pop(t))
+            return true;
+        if (!mOverflowing.load(std::memory_order_acquire))
+            return false;
         MutexLocker locker(&mMutex);
-        if (!mContainer.empty()) {
-            t = std::move(mContainer.front());
-            mContainer.pop();
+        // anything that made it into the ring before the
+        // overflow started has to go first
+        if (mRing.pop(t))
             return true;
-        } else {
+        if (mOverflow.empty())
             return false;
+        t = std::move(mOverflow.front());
+        mOverflow.pop();
+        if (mOverflow.empty())
+            mOverflowing.store(false, std::memory_order_release);
+        return true;
+    }
+
+    // appends everything currently queued to out, returns the number of items
+    size_t pop_all(std::vector<T>& out)
+    {
+        size_t n = 0;
+        T t;
+        while (pop(t)) {
+            out.push_back(std::move(t));
+            ++n;
         }
+        return n;
     }
 
 private:
+    Ring<T> mRing;
+    std::atomic<bool> mOverflowing;
     Mutex mMutex;
-    std::queue<T> mContainer;
+    std::queue<T> mOverflow;
 };
 
 enum UndefinedType { Undefined };
 
-typedef std::variant<double, std::string, const char*, bool, UndefinedType> Variant;
+typedef std::variant<double, std::string, const char*, bool, UndefinedType, std::vector<std::string> > Variant;
 
+// how many of the first size bytes of a and b are the same, sse2/avx2 when
+// the build has them
+size_t common_prefix_length(const char* a, const char* b, size_t size);
+// s extended by what every candidate has in common past s.size()
 std::string longest_common_prefix(const std::string& s, const std::vector<std::string>& candidates);
+// bytewise, the order readline would sort matches in
+void sort_unique(std::vector<std::string>& candidates);
 
 Variant toVariant(Napi::Value value);
 Napi::Value fromVariant(napi_env env, const Variant& variant);
@@ -201,6 +239,12 @@ inline Napi::Value fromVariant(napi_env env, const Variant& variant)
         return Napi::String::New(env, *s);
     } else if (auto s = std::get_if<const char*>(&variant)) {
         return Napi::String::New(env, *s);
+    } else if (auto l = std::get_if<std::vector<std::string> >(&variant)) {
+        Napi::Array array = Napi::Array::New(env, l->size());
+        for (size_t i = 0; i < l->size(); ++i) {
+            array.Set(i, Napi::String::New(env, (*l)[i]));
+        }
+        return array;
     }
     return Napi::Env(env).Undefined();
 }
@@ -0,0 +1,42 @@
+{
+    "variables" : {
+	"conditions": [
+	    # Define variables that points at OS-specific paths.
+	    ["OS=='mac'", {
+		"osx_ver": "<!(bash -c \"sw_vers -productVersion\")",
+	    }]
+	]
+    },
+    "targets": [{
+	"target_name": "git_native",
+	"cflags!": [ "-fno-exceptions" ],
+	"cflags_cc!": [ "-fno-exceptions" ],
+	"cflags_cc": [ "-std=c++17" ],
+	"conditions": [
+	    ['OS=="mac"', {
+		"xcode_settings": {
+		    "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+		    "OTHER_CFLAGS": [ "-std=c++17"],
+		    "MACOSX_DEPLOYMENT_TARGET": "<(osx_ver)",
+		}
+	    }]
+	],
+	"sources": [
+	    "../cppsrc/git.cc",
+	    "../cppsrc/DirScanner.cc",
+	    "../cppsrc/GitCache.cc",
+	    "../cppsrc/GitIgnore.cc",
+	    "../cppsrc/GitIndex.cc",
+	    "../cppsrc/GitRepo.cc",
+	    "../cppsrc/Sha1.cc",
+	    "../cppsrc/utils.cc",
+	],
+	'include_dirs': [
+	    "../cppsrc",
+	    "<!@(node -p \"require('node-addon-api').include\")"
+	],
+	'dependencies': [
+	    "<!(node -p \"require('node-addon-api').gyp\")"
+	]
+    }]
+}
@@ -0,0 +1,59 @@
+// status values are those of status.TrackedStatus and
+// status.UnmergedStatus in src/completion/git/gitutils.ts
+export interface Entry
+{
+    status: number;
+    path: string;
+}
+
+export interface Status
+{
+    tracked?: Entry[];
+    unmerged?: Entry[];
+    untracked?: string[];
+}
+
+export interface Ref
+{
+    refname: string;
+    objectname: string;
+    objecttype: string;
+}
+
+export interface Refs
+{
+    heads?: Ref[];
+    remotes?: Ref[];
+    tags?: Ref[];
+}
+
+// what the watcher keeps for a repository, paths relative to the
+// directory it was asked for like in status()
+export interface Snapshot
+{
+    // changes whenever anything else in here does
+    generation: number;
+    toplevel: string;
+    // the branch, or the abbreviated commit when HEAD is detached
+    head: string;
+    status: Status;
+    refs: Refs;
+}
+
+// each resolves with undefined if path isn't in a repository or the
+// repository uses something that isn't supported, git itself has to
+// answer then
+declare namespace Native
+{
+    export function toplevel(path: string): Promise<string | undefined>;
+    // worktree changes against the index only, paths relative to path
+    export function status(path: string): Promise<Status | undefined>;
+    export function refs(path: string): Promise<Refs | undefined>;
+
+    // synchronous, from the watcher thread's cache. undefined until the
+    // repository has been scanned, the first call starts watching it
+    export function generation(path: string): number | undefined;
+    export function snapshot(path: string): Snapshot | undefined;
+}
+
+export default Native;
@@ -0,0 +1,17 @@
+var native;
+var ok = false;
+
+try {
+    native = require('./build/Debug/git_native.node');
+    module.exports = native;
+    ok = true;
+} catch (e) {
+    if (e.code !== 'MODULE_NOT_FOUND') {
+        throw e;
+    }
+}
+
+if (!ok) {
+    native = require('./build/Release/git_native.node');
+    module.exports = native;
+}
@@ -23,6 +23,11 @@
 	],
 	"sources": [
 	    "../cppsrc/process.cc",
+	    "../cppsrc/Poller.cc",
+	    "../cppsrc/BufferPool.cc",
+	    "../cppsrc/PathIndex.cc",
+	    "../cppsrc/DirScanner.cc",
+	    "../cppsrc/DirCache.cc",
 	    "../cppsrc/utils.cc",
 	],
 	'include_dirs': [
@@ -2,14 +2,19 @@ export interface InCtx {}
 export interface OutCtx {}
 export interface ProcessCtx {}
 
+// "error" can be reported after launch() has returned if the exec fails,
+// a process that failed to launch never reports "exited"
 export type StatusOn = "exited" | "stopped" | "error";
 
 export interface Launch
 {
     pid: number;
-    write: (ctx: InCtx, buffer?: Buffer) => void;
+    write: (ctx: InCtx, buffer?: Buffer, callback?: () => void) => void;
     close: (ctx: InCtx) => void;
-    listen: (ctx: OutCtx, listener: (buffer: Buffer) => void) => void;
+    // the pipe stops being read once highWaterMark bytes (256k by default)
+    // have been delivered, until resume() is called
+    listen: (ctx: OutCtx, listener: (buffer: Buffer) => void, highWaterMark?: number) => void;
+    resume: (ctx: OutCtx) => void;
     setMode: (ctx: ProcessCtx, mode: "foreground" | "background", resume: boolean) => void;
     processCtx: ProcessCtx;
     stdoutCtx?: OutCtx;
@@ -38,12 +43,115 @@ export interface Options
     redirectStderr: boolean;
     originalStdout: number;
     originalStderr: number;
+    // hand the output of another process directly to our stdin,
+    // implies redirectStdin: false. The ctx must not have a listener
+    stdinFrom?: OutCtx;
     interactive: {
         foreground: boolean;
         pgid: number | undefined;
     } | undefined;
 }
 
+export interface PathExecutables
+{
+    // changes whenever the set of executables does
+    generation: number;
+    // left out if generation is the one passed in
+    names?: string[];
+}
+
+export type ScanFilter = "executableOrDirectory";
+
+export interface ScanDirStats
+{
+    hits: number;
+    misses: number;
+    evictions: number;
+    // lookups that only had to search the previous prefix's matches
+    narrowed: number;
+    // what's currently cached
+    dirs: number;
+    entries: number;
+}
+
+export interface BatchingOptions
+{
+    // largest Buffer handed to a listener in one call, chunks
+    // that arrive close together are merged up to this size
+    maxBytes?: number;
+    // milliseconds the reader may hold on to output before handing it
+    // to js, unless maxBytes are buffered first. 0 delivers right away
+    maxLatency?: number;
+}
+
+export interface BufferPoolStats
+{
+    // reads served from / allocated outside of the pool
+    hits: number;
+    misses: number;
+    // buffers currently cached in the pool
+    free: number;
+    bufferSize: number;
+}
+
+export interface ProcessStats
+{
+    pid: number;
+    cmd: string;
+    // bytes through each redirected stream so far
+    stdoutBytes?: number;
+    stderrBytes?: number;
+    stdinBytes?: number;
+}
+
+export interface Stats
+{
+    // reader thread wakeups, the fd events they carried and
+    // how many were timeouts for batched output
+    wakeups: number;
+    events: number;
+    timeouts: number;
+    reads: number;
+    bytesRead: number;
+    // times a pipe was left alone because js fell behind
+    throttled: number;
+    writes: number;
+    bytesWritten: number;
+    // writes that hit a full pipe
+    writesBlocked: number;
+    // wakeups of the js thread, asyncSends / asyncCallbacks is how much they coalesce
+    asyncSends: number;
+    asyncCallbacks: number;
+    sigchlds: number;
+    reaps: number;
+    stops: number;
+    launches: number;
+    launchFailures: number;
+    // most chunks drained from one pipe, and most pipes, in one js wakeup
+    queueDepthPeak: number;
+    pendingEmittersPeak: number;
+    launchLatency: {
+        count: number;
+        meanUs: number;
+        p50Us: number;
+        p99Us: number;
+        // buckets[n] counts launches that took [2^(n-1), 2^n) microseconds
+        buckets: number[];
+    };
+    bufferPool: BufferPoolStats;
+    // processes that haven't been reported as exited yet
+    processes: ProcessStats[];
+}
+
+export interface PipelineStage
+{
+    cmd: string;
+    args?: string[];
+    env?: {[key: string]: string | undefined};
+    callback: (type: StatusOn, status?: number | string) => void;
+    redirs?: Redirection[];
+}
+
 declare namespace Native
 {
     export function start(): void;
@@ -58,6 +166,24 @@ declare namespace Native
         opts: Options,
         redirs?: Redirection[]
     ): Launch;
+    // launches all stages in one go, each stage's stdout is connected
+    // directly to the next stage's stdin. opts.redirectStdin and
+    // opts.stdinFrom apply to the first stage, opts.redirectStdout
+    // to the last one. Returns one Launch per stage
+    export function launchPipeline(stages: PipelineStage[], opts: Options): Launch[];
+    // command name -> executable for the given PATH, the index is
+    // kept up to date through inotify on the PATH directories
+    export function pathLookup(path: string, cmd: string): Promise<string | undefined>;
+    export function pathExecutables(path: string, since?: number): Promise<PathExecutables>;
+    // entries of path starting with prefix, ignoring ascii case and sorted
+    // the same way. Directories end in a slash, . and .. are included
+    // listings are cached until the directory's mtime changes
+    export function scanDir(path: string, prefix: string, filter?: ScanFilter): Promise<string[]>;
+    export function scanDirStats(): ScanDirStats;
+    export function setBatching(opts: BatchingOptions): void;
+    export function bufferPoolStats(): BufferPoolStats;
+    // counters from the i/o path, reset clears them after reading
+    export function stats(reset?: boolean): Stats;
 }
 
 export const enum Signals {
@@ -28,8 +28,12 @@
 	],
 	"sources": [
 	    "../cppsrc/readline.cc",
+	    "../cppsrc/HistorySearch.cc",
+	    "../cppsrc/HistoryStore.cc",
+	    "../cppsrc/QuoteTable.cc",
 	    "../cppsrc/utils.cc",
 	    "../cppsrc/Redirector.cc",
+	    "../cppsrc/Tracer.cc",
 	],
 	'include_dirs': [
 	    "../cppsrc",
@@ -4,7 +4,12 @@ export interface Completion
     text: string;
     start: number;
     end: number;
+    // a single match replaces the text as is. with more, the first
+    // element is the text they complete and the rest are the matches,
+    // sorted, deduplicated and reduced to their common prefix natively
     complete(data?: string[]): void;
+    // true once the user has moved on, the results would be dropped
+    superseded(): boolean;
 }
 
 export interface Data
@@ -34,7 +39,16 @@ declare namespace Native
     export function addHistory(line: string, write?: boolean): Promise<void>;
     export function writeHistory(file: string): Promise<void>;
     export function readHistory(file: string): Promise<void>;
+    export function searchHistory(query: string, limit?: number): Promise<string[]>;
     export function realFDs(): { stdout: number, stderr: number };
+    // redirected output is written and the prompt redrawn at most this
+    // many times a second, 60 by default. 0 writes output as it arrives
+    export function setFrameRate(hz: number): Promise<void>;
+    // records what the readline thread spends its time on, keystrokes,
+    // redisplays, redirected output and tasks, in a ring of capacity spans
+    export function trace(enabled: boolean, capacity?: number): Promise<void>;
+    // chrome trace event json, load it in chrome://tracing or perfetto
+    export function traceDump(): Promise<string>;
     export const log: Log;
 }
 
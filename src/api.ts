@@ -7,4 +7,5 @@ export interface API {
     export(name: string, value: string | undefined): void;
     run(cmdline: string): Promise<SubshellResult>;
     setPrompt(prompt: string): Promise<void>;
+    setFrameRate(hz: number): Promise<void>;
 }
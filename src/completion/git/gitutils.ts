@@ -1,5 +1,7 @@
 import { execFile } from "child_process";
+import { resolve } from "path";
 import { cache } from "../cache";
+import { default as Git, Snapshot as GitSnapshot } from "../../../native/git";
 
 const promise = {
     execFile: (file: string, args: string[], options?: { cwd: string }): Promise<{ stdout: string, stderr: string }> => {
@@ -15,7 +17,40 @@ const promise = {
     }
 };
 
+// the watcher's snapshots, converted once per generation. these
+// outlive the completion cache, the generation says when they're stale
+const snapshots: Map<string, GitSnapshot> = new Map<string, GitSnapshot>();
+
+function watched(path: string): GitSnapshot | undefined {
+    // paths in the snapshot are relative to this, "." means something else after a cd
+    const key = resolve(path);
+    const generation = Git.generation(key);
+    if (generation === undefined) {
+        snapshots.delete(key);
+        return undefined;
+    }
+    const hit = snapshots.get(key);
+    if (hit !== undefined && hit.generation === generation) {
+        return hit;
+    }
+    const snapshot = Git.snapshot(key);
+    if (snapshot === undefined) {
+        snapshots.delete(key);
+        return undefined;
+    }
+    snapshots.set(key, snapshot);
+    return snapshot;
+}
+
 export async function toplevel(path: string): Promise<string | undefined> {
+    const snapshot = watched(path);
+    if (snapshot !== undefined) {
+        return snapshot.toplevel;
+    }
+    const top = await Git.toplevel(path);
+    if (top !== undefined) {
+        return top;
+    }
     try {
         const data = await promise.execFile("git", ["rev-parse", "--show-toplevel"], { cwd: path });
         const top = data.stdout.trimRight();
@@ -169,11 +204,24 @@ export namespace status {
     }
 
     export async function get(path: string): Promise<Status | undefined> {
+        const snapshot = watched(path);
+        if (snapshot !== undefined) {
+            return snapshot.status as Status;
+        }
+
         const hit = cache.get("gitstatus", path);
         if (hit !== undefined) {
             return hit as Status;
         }
 
+        // the native reader only compares the worktree with the index,
+        // which is all completion looks at
+        const native = await Git.status(path);
+        if (native !== undefined) {
+            cache.set("gitstatus", path, native);
+            return native as Status;
+        }
+
         let data: { stdout: string, stderr: string } | undefined;
         try {
             data = await promise.execFile("git", ["status", "--branch", "-u", "--porcelain=v2"], { cwd: path });
@@ -247,11 +295,22 @@ export namespace branch {
     }
 
     export async function get(path: string): Promise<Branches | undefined> {
+        const snapshot = watched(path);
+        if (snapshot !== undefined) {
+            return snapshot.refs;
+        }
+
         const hit = cache.get("gitbranch", path);
         if (hit !== undefined) {
             return hit as Branches;
         }
 
+        const native = await Git.refs(path);
+        if (native !== undefined) {
+            cache.set("gitbranch", path, native);
+            return native;
+        }
+
         let data: { stdout: string, stderr: string } | undefined;
         try {
             data = await promise.execFile("git", ["for-each-ref", "refs/", "--format", "%(refname)%00%(objectname:short)%00%(objecttype)"], { cwd: path });
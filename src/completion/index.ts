@@ -31,7 +31,8 @@ export function complete(data: ReadlineCompletion)
     }
 
     completer(cmd, data).then(completion => {
-        data.complete(completion);
+        if (!data.superseded())
+            data.complete(completion);
     }).catch(err => {
         console.error(err);
         data.complete([]);
@@ -414,6 +414,9 @@ process.on("unhandledRejection", (reason, promise) => {
         },
         setPrompt: async (prompt: string): Promise<void> => {
             return Readline.setPrompt(prompt);
+        },
+        setFrameRate: async (hz: number): Promise<void> => {
+            return Readline.setFrameRate(hz);
         }
     };
     await loadConfig(configDir, api);
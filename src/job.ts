@@ -84,6 +84,21 @@ export class Job extends EventEmitter
                 this._stopped = 0;
             }
         });
+
+        proc.on("error", () => {
+            // the process failed to launch, it won't exit
+            const idx = this._procs.indexOf(proc);
+            if (idx === -1) {
+                throw new Error(`Failed process that doesn't exist`);
+            }
+            this._procs.splice(idx, 1);
+
+            ++this._finished;
+            if (this._finished === this._total) {
+                this.emit("finished", undefined);
+                this._stopped = 0;
+            }
+        });
     }
 
     setForeground() {
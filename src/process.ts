@@ -6,7 +6,8 @@ import {
     Options as NativeProcessOptions,
     StatusOn as NativeProcessStatusOn,
     Redirection as NativeProcessRedirection,
-    Signals as NativeProcessSignals
+    Signals as NativeProcessSignals,
+    PipelineStage as NativeProcessPipelineStage
 } from "../native/process";
 
 import { EventEmitter } from "events";
@@ -28,8 +29,8 @@ class ProcessWriter extends Writable
     }
 
     _write(buf: Buffer, encoding: string, callback: (err: any) => void) {
-        this._launch.write(this._ctx, buf);
-        callback(null);
+        // the native side writes straight out of buf, it's ours again once this is called
+        this._launch.write(this._ctx, buf, () => callback(null));
     }
 
     _final(callback: () => void) {
@@ -86,62 +87,118 @@ class ProcessReader extends Readable
         }
         this._buffers = [];
         this._paused = false;
+        // let the native side read from the pipe again if it hit its high water mark
+        this._launch.resume(this._ctx);
     }
 }
 
+export interface PipelineStage
+{
+    cmd: string;
+    args: string[];
+    env: {[key: string]: string | undefined};
+    redirs?: NativeProcessRedirection[];
+}
+
 export class Process extends EventEmitter
 {
-    private _launch: NativeProcessLaunch;
+    private _launch!: NativeProcessLaunch;
     private _status: Promise<number | undefined>;
     private _statusResolve: StatusResolveFunction | undefined;
     private _statusReject: RejectFunction | undefined;
     private _name: string;
+    private _stdout: ProcessReader | undefined;
+    private _failed: boolean;
 
-    constructor(cmd: string, args: string[], env: {[key: string]: string | undefined}, opts: NativeProcessOptions, redirs?: NativeProcessRedirection[]) {
+    constructor(cmd: string, args?: string[], env?: {[key: string]: string | undefined}, opts?: NativeProcessOptions, redirs?: NativeProcessRedirection[]) {
         super();
 
         this._name = cmd;
+        this._failed = false;
 
         this._status = new Promise<number | undefined>((resolve, reject) => {
             this._statusResolve = resolve;
             this._statusReject = reject;
         });
-        this._launch = NativeProcess.launch(cmd, args, env, (type: NativeProcessStatusOn, status?: number | string) => {
-            switch (type) {
-            case "error":
+        // launchPipeline() launches its processes itself
+        if (opts !== undefined) {
+            this._launch = NativeProcess.launch(cmd, args, env, this._onStatus.bind(this), opts, redirs);
+        }
+    }
+
+    static launchPipeline(stages: PipelineStage[], opts: NativeProcessOptions): Process[] {
+        const procs = stages.map(stage => new Process(stage.cmd));
+        const nstages: NativeProcessPipelineStage[] = stages.map((stage, idx) => {
+            return {
+                cmd: stage.cmd,
+                args: stage.args,
+                env: stage.env,
+                redirs: stage.redirs,
+                callback: procs[idx]._onStatus.bind(procs[idx])
+            };
+        });
+        const launches = NativeProcess.launchPipeline(nstages, opts);
+        for (let i = 0; i < procs.length; ++i) {
+            procs[i]._launch = launches[i];
+        }
+        return procs;
+    }
+
+    private _onStatus(type: NativeProcessStatusOn, status?: number | string) {
+        switch (type) {
+        case "error":
+            this._failed = true;
+            // launch failures are reported asynchronously, don't
+            // throw from the native callback if nobody is listening
+            if (this.listenerCount("error") > 0) {
                 this.emit("error", status as string);
-                if (this._statusReject) {
-                    this._statusReject(status);
-                }
-                break;
-            case "stopped":
-                this.emit("stopped", { status: status as number, process: this });
+            }
+            if (this._statusReject) {
+                this._statusReject(status);
+            }
+            break;
+        case "stopped":
+            this.emit("stopped", { status: status as number, process: this });
+            break;
+        case "exited":
+            this.emit("exited", { status: status as number, process: this });
+            if (this._statusResolve) {
+                this._statusResolve(status as number);
                 break;
-            case "exited":
-                this.emit("exited", { status: status as number, process: this });
-                if (this._statusResolve) {
-                    this._statusResolve(status as number);
-                    break;
-                }
             }
-        }, opts, redirs);
+        }
     }
 
     get name() {
         return this._name;
     }
 
+    get failed() {
+        return this._failed;
+    }
+
     get status() {
         return this._status;
     }
 
     get stdout() {
+        if (this._stdout) {
+            return this._stdout;
+        }
         if (this._launch.stdoutCtx) {
-            return new ProcessReader(this._launch.stdoutCtx, this._launch, this._status);
+            this._stdout = new ProcessReader(this._launch.stdoutCtx, this._launch, this._status);
+            return this._stdout;
         }
         throw new Error("Invalid process");
     }
 
+    get stdoutCtx() {
+        if (this._launch.stdoutCtx && !this._stdout) {
+            return this._launch.stdoutCtx;
+        }
+        throw new Error("stdout not available");
+    }
+
     get stderr() {
         if (this._launch.stderrCtx) {
             return new ProcessReader(this._launch.stderrCtx, this._launch, this._status);
@@ -7,6 +7,7 @@ import { expand } from "./expand";
 import { env as envGet, push as envPush, pop as envPop, EnvType } from "./variable";
 import { declaredCommands, builtinCommands, CommandFunction } from "./commands";
 import { parseRedirections } from "./redirs";
+import { Redirection } from "../native/process";
 import { assert } from "./assert";
 import { default as Readline } from "../native/readline";
 import { default as Shell } from "../native/shell";
@@ -20,6 +21,16 @@ export interface CmdResult
     stdin: Writable | undefined;
     stdout: Readable | undefined;
     status: Promise<number | undefined>;
+    // stdin is connected directly to the stdout of the previous process in the pipe
+    spliced?: boolean;
+}
+
+interface CmdPipeOptions
+{
+    // native process whose stdout should become our stdin
+    stdinFrom?: Process;
+    // the next stage might take over our stdout, don't read it until asked
+    deferStdout?: boolean;
 }
 
 export const originalFDs = { stdout: -1, stderr: -1 };
@@ -108,7 +119,19 @@ function runGeneratorCommand(command: CommandFunction, args: string[], env: EnvT
     };
 }
 
-export async function runCmd(cmds: any, source: string, opts: ProcessOptions, job?: Job): Promise<{ pid: number, result: CmdResult }> {
+interface PreparedCmd
+{
+    name: string;
+    args: string[];
+    env: EnvType;
+    // declared and builtin commands
+    command?: CommandFunction;
+    // everything else
+    path?: string;
+    redirs?: Redirection[];
+}
+
+async function prepareCmd(cmds: any, source: string): Promise<PreparedCmd> {
     envPush();
 
     try {
@@ -135,41 +158,100 @@ export async function runCmd(cmds: any, source: string, opts: ProcessOptions, jo
         }
 
         if (cmd in declaredCommands.commands) {
-            const declared = declaredCommands.commands[cmd];
-            return { pid: -1, result: runGeneratorCommand(declared, args, env, opts) };
+            return { name: cmd, args: args, env: env, command: declaredCommands.commands[cmd] };
         }
         if (cmd in builtinCommands) {
-            const builtin = builtinCommands[cmd as keyof typeof builtinCommands];
-            return { pid: -1, result: runGeneratorCommand(builtin, args, env, opts) };
-        }
-
-        if (job && !job.valid && job.foreground) {
-            await Readline.pause();
+            return { name: cmd, args: args, env: env, command: builtinCommands[cmd as keyof typeof builtinCommands] };
         }
 
         const rcmd = await pathify(cmd);
-        const proc = new Process(rcmd, args, env, opts, parseRedirections(cmds.redirs));
-
-        if (job) {
-            job.addProcess(proc);
-        }
+        const redirs = parseRedirections(cmds.redirs);
 
         envPop();
 
-        return {
-            pid: proc.pid,
-            result: {
-                stdin: opts.redirectStdin ? proc.stdin : undefined,
-                stdout: opts.redirectStdout ? proc.stdout : undefined,
-                status: proc.status
-            }
-        };
+        return { name: cmd, args: args, env: env, path: rcmd, redirs: redirs };
     } catch (e) {
         envPop();
         throw e;
     }
 }
 
+async function runPrepared(cmd: PreparedCmd, opts: ProcessOptions, job?: Job, pipe?: CmdPipeOptions): Promise<{ pid: number, result: CmdResult, process?: Process }> {
+    if (cmd.command !== undefined) {
+        return { pid: -1, result: runGeneratorCommand(cmd.command, cmd.args, cmd.env, opts) };
+    }
+    assert(cmd.path !== undefined);
+
+    if (job && !job.valid && job.foreground) {
+        await Readline.pause();
+    }
+
+    const stdinFrom = pipe !== undefined ? pipe.stdinFrom : undefined;
+    const popts = stdinFrom !== undefined ? { ...opts, redirectStdin: false, stdinFrom: stdinFrom.stdoutCtx } : opts;
+    const proc = new Process(cmd.path, cmd.args, cmd.env, popts, cmd.redirs);
+    if (proc.failed) {
+        // the status promise has been rejected already and nobody is going to wait for it
+        proc.status.catch(() => {});
+        throw new Error(`Failed to launch ${cmd.name}`);
+    }
+
+    if (job) {
+        job.addProcess(proc);
+    }
+
+    const result: CmdResult = {
+        stdin: popts.redirectStdin ? proc.stdin : undefined,
+        stdout: undefined,
+        status: proc.status,
+        spliced: stdinFrom !== undefined
+    };
+    if (opts.redirectStdout) {
+        if (pipe !== undefined && pipe.deferStdout) {
+            Object.defineProperty(result, "stdout", { get: () => proc.stdout });
+        } else {
+            result.stdout = proc.stdout;
+        }
+    }
+
+    return {
+        pid: proc.pid,
+        result: result,
+        process: proc
+    };
+}
+
+export async function runCmd(cmds: any, source: string, opts: ProcessOptions, job?: Job, pipe?: CmdPipeOptions): Promise<{ pid: number, result: CmdResult, process?: Process }> {
+    return runPrepared(await prepareCmd(cmds, source), opts, job, pipe);
+}
+
+// launches a pipe of external commands with one native call,
+// only the first stage's stdin and the last stage's stdout go through js
+async function runPipeline(cmds: PreparedCmd[], opts: ProcessOptions, job: Job): Promise<CmdResult[]> {
+    if (!job.valid && job.foreground) {
+        await Readline.pause();
+    }
+
+    const procs = Process.launchPipeline(cmds.map(cmd => {
+        assert(cmd.path !== undefined);
+        return { cmd: cmd.path, args: cmd.args, env: cmd.env, redirs: cmd.redirs };
+    }), opts);
+
+    const results: CmdResult[] = [];
+    for (let i = 0; i < procs.length; ++i) {
+        const proc = procs[i];
+        if (!proc.failed) {
+            job.addProcess(proc);
+        }
+        results.push({
+            stdin: i === 0 && opts.redirectStdin && !proc.failed ? proc.stdin : undefined,
+            stdout: i === procs.length - 1 && opts.redirectStdout && !proc.failed ? proc.stdout : undefined,
+            status: proc.status,
+            spliced: i > 0
+        });
+    }
+    return results;
+}
+
 interface SubshellOptions
 {
     readable?: ShellReader;
@@ -259,13 +341,39 @@ class Pipe
             });
         }
 
+        // if every stage is an external command we can launch the whole pipe at once
+        let prepared: PreparedCmd[] | undefined;
+        if (this._pipes.every((p: any) => p.type === "cmd")) {
+            prepared = [];
+            for (const p of this._pipes) {
+                prepared.push(await prepareCmd(p, this._source));
+            }
+        }
+
         let source: Readable | undefined = firstSource;
         let pgid = this._opts.pgid;
-        for (let i = 0; i < pnum; ++i) {
+        // adjacent native processes are connected directly, without going through js
+        let previous: Process | undefined;
+        if (prepared !== undefined && pnum > 1 && prepared.every(cmd => cmd.command === undefined)) {
+            all.push(...await runPipeline(prepared, {
+                redirectStdin: source !== undefined,
+                redirectStdout: finalDestination !== undefined,
+                redirectStderr: false,
+                originalStdout: originalFDs.stdout,
+                originalStderr: originalFDs.stderr,
+                interactive: {
+                    foreground: foreground,
+                    pgid: pgid
+                }
+            }, this._job));
+        }
+        for (let i = all.length; i < pnum; ++i) {
             const p = this._pipes[i];
             switch (p.type) {
             case "cmd":
-                const cmdr = await runCmd(p, this._source, {
+                const next = i < pnum - 1 ? this._pipes[i + 1] : undefined;
+                const cmdp = prepared !== undefined ? prepared[i] : await prepareCmd(p, this._source);
+                const cmdr = await runPrepared(cmdp, {
                     redirectStdin: source !== undefined || i > 0,
                     redirectStdout : i < pnum - 1 || finalDestination !== undefined,
                     redirectStderr: false,
@@ -275,8 +383,15 @@ class Pipe
                         foreground: foreground,
                         pgid: pgid
                     }
-                }, this._job);
-                pgid = cmdr.pid;
+                }, this._job, {
+                    stdinFrom: previous,
+                    deferStdout: next !== undefined && next.type === "cmd"
+                });
+                // the first stage leads the group, later ones join it
+                if (pgid === undefined || pgid <= 0) {
+                    pgid = cmdr.pid;
+                }
+                previous = cmdr.process;
                 all.push(cmdr.result);
                 break;
             case "subshell":
@@ -295,12 +410,14 @@ class Pipe
                     stdin: subopts.writable,
                     status: subshell(p, this._source, subopts)
                 });
+                previous = undefined;
                 break;
             case "jscode":
                 all.push(await runJS(p, this._source, {
                     redirectStdin: source !== undefined || i > 0,
                     redirectStdout: i < pnum - 1 || finalDestination !== undefined
                 }));
+                previous = undefined;
                 break;
             }
         }
@@ -323,13 +440,15 @@ class Pipe
             if (i < anum - 1) {
                 // pipe previous to next
                 const n = all[i + 1];
-                if (a.stdout === undefined) {
-                    throw new Error("No stdout");
-                }
-                if (n.stdin === undefined) {
-                    throw new Error("No stdin");
+                if (!n.spliced) {
+                    if (a.stdout === undefined) {
+                        throw new Error("No stdout");
+                    }
+                    if (n.stdin === undefined) {
+                        throw new Error("No stdin");
+                    }
+                    a.stdout.pipe(n.stdin);
                 }
-                a.stdout.pipe(n.stdin);
             } else if (i === anum - 1) {
                 // at end
                 if (finalDestination !== undefined) {
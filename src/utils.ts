@@ -1,4 +1,3 @@
-import { join as pathJoin } from "path";
 import { stat } from "fs";
 import { promisify } from "util";
 import { env } from "./variable";
@@ -13,24 +12,11 @@ export async function pathify(cmd: string): Promise<string> {
     if (cmd.includes("/")) {
         return cmd;
     }
-    const paths = (env().PATH || "").split(":");
-
-    for (const p of paths) {
-        try {
-            const j = pathJoin(p, cmd);
-            const stats = await pstat(j);
-            if (stats.isFile()) {
-                if ((uid === stats.uid && (stats.mode & 0o500) === 0o500)
-                    || (gids.includes(stats.gid) && (stats.mode & 0o050) === 0o050)
-                    || ((stats.mode & 0o005) === 0o005)) {
-                    return j;
-                }
-            }
-        } catch (e) {
-        }
+    const resolved = await Process.pathLookup(env().PATH || "", cmd);
+    if (resolved === undefined) {
+        throw new Error(`Unable to find ${cmd} in PATH`);
     }
-
-    throw new Error(`Unable to find ${cmd} in PATH`);
+    return resolved;
 }
 
 export async function isExecutable(path: string): Promise<boolean> {
@@ -0,0 +1,195 @@
+// the process_native i/o path: spawn latency, pipe throughput through
+// BufferEmitter and handleWrite, the cost of each js callback and of
+// many processes sharing the reader loop
+//
+// usage: node io.js [MB] [benchmark, ...]
+// benchmarks: spawn read write roundtrip callbacks concurrent (all by default)
+// prints one json object per line, compare runs with the same MB
+
+const path = require("path");
+const native = require(path.join(__dirname, "../../native/process"));
+
+const megabytes = parseInt(process.argv[2]) || 256;
+const selected = process.argv.length > 3 ? process.argv.slice(3) : ["spawn", "read", "write", "roundtrip", "callbacks", "concurrent"];
+const total = megabytes * 1024 * 1024;
+
+const opts = {
+    redirectStdin: false,
+    redirectStdout: false,
+    redirectStderr: false,
+    originalStdout: 1,
+    originalStderr: 2,
+    interactive: undefined
+};
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function now() {
+    return process.hrtime.bigint();
+}
+
+function seconds(start) {
+    return Number(process.hrtime.bigint() - start) / 1e9;
+}
+
+function report(obj) {
+    console.log(JSON.stringify(Object.assign({ bench: "io" }, obj)));
+}
+
+// resolves with the stats once the process has exited and, if expected
+// is given, that many bytes have come through stdout
+function run(cmd, args, options, expected, feed) {
+    return new Promise((resolve, reject) => {
+        let exited = false;
+        let received = 0;
+        let chunks = 0;
+        const done = () => {
+            if (exited && (expected === undefined || received >= expected))
+                resolve({ received: received, chunks: chunks });
+        };
+        const launch = native.launch(cmd, args, {}, (type, status) => {
+            if (type === "error") {
+                reject(new Error(`${cmd}: ${status}`));
+            } else if (type === "exited") {
+                exited = true;
+                done();
+            }
+        }, Object.assign({}, opts, options));
+        if (launch.stdoutCtx) {
+            launch.listen(launch.stdoutCtx, buf => {
+                received += buf.length;
+                ++chunks;
+                // drained right away, keep the pipe flowing
+                launch.resume(launch.stdoutCtx);
+                done();
+            });
+        }
+        if (launch.stderrCtx) {
+            // nothing looks at stderr, drain it so it doesn't sit in the pipe
+            launch.listen(launch.stderrCtx, () => {
+                launch.resume(launch.stderrCtx);
+            });
+        }
+        if (feed)
+            feed(launch);
+    });
+}
+
+function feedZeroes(size) {
+    return launch => {
+        const chunk = Buffer.alloc(65536);
+        for (let written = 0; written < size; written += chunk.length) {
+            launch.write(launch.stdinCtx, size - written < chunk.length ? chunk.subarray(0, size - written) : chunk);
+        }
+        launch.close(launch.stdinCtx);
+    };
+}
+
+function throughput(name, stats, start, bytes, extra) {
+    const secs = seconds(start);
+    report(Object.assign({
+        name: name,
+        bytes: bytes,
+        seconds: secs,
+        mbPerSec: bytes / secs / (1024 * 1024),
+        chunks: stats.chunks,
+        avgChunk: stats.chunks ? Math.round(stats.received / stats.chunks) : 0
+    }, extra));
+}
+
+const benchmarks = {
+    spawn: async () => {
+        const iterations = 500;
+        for (const redirect of [false, true]) {
+            const options = { redirectStdin: redirect, redirectStdout: redirect, redirectStderr: redirect };
+            const times = [];
+            for (let i = 0; i < iterations; ++i) {
+                const start = now();
+                const exited = run("/bin/true", [], options);
+                times.push(Number(now() - start) / 1000);
+                await exited;
+            }
+            times.sort((a, b) => a - b);
+            report({
+                name: "spawn",
+                redirected: redirect,
+                iterations: iterations,
+                meanUs: times.reduce((a, b) => a + b, 0) / times.length,
+                p50Us: percentile(times, 0.5),
+                p99Us: percentile(times, 0.99)
+            });
+        }
+    },
+    read: async () => {
+        const start = now();
+        const stats = await run("head", ["-c", `${total}`, "/dev/zero"], { redirectStdout: true }, total);
+        throughput("read", stats, start, total, { pool: native.bufferPoolStats() });
+    },
+    write: async () => {
+        const start = now();
+        const stats = await run("/bin/sh", ["-c", "exec cat > /dev/null"], { redirectStdin: true }, undefined, feedZeroes(total));
+        throughput("write", stats, start, total);
+    },
+    roundtrip: async () => {
+        const start = now();
+        const stats = await run("cat", [], { redirectStdin: true, redirectStdout: true }, total, feedZeroes(total));
+        throughput("roundtrip", stats, start, total);
+    },
+    callbacks: async () => {
+        // the smaller the batches the more of the time goes to calling into js
+        for (const maxBytes of [4096, 16384, 65536, 1024 * 1024]) {
+            native.setBatching({ maxBytes: maxBytes });
+            const start = now();
+            const stats = await run("head", ["-c", `${total}`, "/dev/zero"], { redirectStdout: true }, total);
+            const secs = seconds(start);
+            report({
+                name: "callbacks",
+                maxBytes: maxBytes,
+                bytes: total,
+                seconds: secs,
+                chunks: stats.chunks,
+                usPerChunk: secs * 1e6 / stats.chunks
+            });
+        }
+        native.setBatching({ maxBytes: 65536 });
+    },
+    concurrent: async () => {
+        for (const count of [1, 8, 32, 128]) {
+            const each = Math.floor(total / count);
+            const start = now();
+            const all = [];
+            for (let i = 0; i < count; ++i) {
+                all.push(run("head", ["-c", `${each}`, "/dev/zero"], { redirectStdout: true }, each));
+            }
+            const results = await Promise.all(all);
+            const chunks = results.reduce((a, r) => a + r.chunks, 0);
+            const secs = seconds(start);
+            report({
+                name: "concurrent",
+                processes: count,
+                bytes: each * count,
+                seconds: secs,
+                mbPerSec: each * count / secs / (1024 * 1024),
+                chunks: chunks
+            });
+        }
+    }
+};
+
+(async () => {
+    native.start();
+    for (const name of selected) {
+        if (!(name in benchmarks)) {
+            console.error(`unknown benchmark ${name}`);
+            process.exitCode = 1;
+            continue;
+        }
+        await benchmarks[name]();
+    }
+    native.stop();
+})().catch(err => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,86 @@
+// launch latency of process_native against the size of the js heap,
+// once through posix_spawn and once through the fork() fallback
+//
+// usage: node launch.js [iterations] [heap MB, ...]
+// prints one json object per line
+
+const path = require("path");
+const { spawnSync } = require("child_process");
+
+const iterations = parseInt(process.argv[2]) || 200;
+const heaps = process.argv.length > 3 ? process.argv.slice(3).map(x => parseInt(x)) : [0, 256, 1024, 2048];
+
+const opts = {
+    redirectStdin: false,
+    redirectStdout: false,
+    redirectStderr: false,
+    originalStdout: 1,
+    originalStderr: 2,
+    interactive: undefined
+};
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+async function child(mode) {
+    const native = require(path.join(__dirname, "../../native/process"));
+    native.start();
+
+    const retained = [];
+    let allocated = 0;
+
+    for (const heap of heaps) {
+        // grow the heap with small objects so that v8 actually maps and touches the pages
+        while (allocated < heap) {
+            const chunk = new Array(1024 * 16);
+            for (let i = 0; i < chunk.length; ++i) {
+                chunk[i] = { a: i, b: "x" + i };
+            }
+            retained.push(chunk);
+            allocated = process.memoryUsage().heapUsed / (1024 * 1024);
+        }
+
+        const times = [];
+        for (let i = 0; i < iterations; ++i) {
+            let done;
+            const exited = new Promise(resolve => { done = resolve; });
+            const start = process.hrtime.bigint();
+            native.launch("/bin/true", [], {}, type => {
+                if (type !== "stopped")
+                    done();
+            }, opts);
+            times.push(Number(process.hrtime.bigint() - start) / 1000);
+            await exited;
+        }
+
+        times.sort((a, b) => a - b);
+        console.log(JSON.stringify({
+            bench: "launch",
+            mode: mode,
+            heapMB: Math.round(allocated),
+            iterations: iterations,
+            meanUs: times.reduce((a, b) => a + b, 0) / times.length,
+            p50Us: percentile(times, 0.5),
+            p99Us: percentile(times, 0.99)
+        }));
+    }
+
+    native.stop();
+    process.exit(0);
+}
+
+if (process.env.JSH_BENCH_CHILD) {
+    child(process.env.JSH_BENCH_CHILD);
+} else {
+    const max = Math.max(...heaps) * 2 + 512;
+    for (const mode of ["spawn", "fork"]) {
+        const env = Object.assign({}, process.env, { JSH_BENCH_CHILD: mode });
+        if (mode === "fork") {
+            env.JSH_FORCE_FORK = "1";
+        } else {
+            delete env.JSH_FORCE_FORK;
+        }
+        spawnSync(process.execPath, [`--max-old-space-size=${max}`, __filename, ...process.argv.slice(2)], { env: env, stdio: "inherit" });
+    }
+}
@@ -0,0 +1,115 @@
+// throughput of the lock-free Queue in utils.h against the mutex and
+// std::queue implementation it replaced, with one and with several
+// producers feeding a single consumer
+//
+// build from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Inative/cppsrc
+//       -I"$(node -p "require('node-addon-api').include_dir")"
+//       -I"$(node -p "require('path').resolve(process.execPath, '../../include/node')")"
+//       tests/bench/queue.cc -o queue-bench -luv
+//
+// usage: ./queue-bench [items]
+// prints one json object per line
+
+#include "utils.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+template<typename T>
+class LockedQueue
+{
+public:
+    void push(T&& t)
+    {
+        MutexLocker locker(&mMutex);
+        mContainer.push(std::forward<T>(t));
+    }
+
+    bool pop(T& t)
+    {
+        MutexLocker locker(&mMutex);
+        if (!mContainer.empty()) {
+            t = std::move(mContainer.front());
+            mContainer.pop();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    size_t pop_all(std::vector<T>& out)
+    {
+        size_t n = 0;
+        T t;
+        while (pop(t)) {
+            out.push_back(std::move(t));
+            ++n;
+        }
+        return n;
+    }
+
+private:
+    Mutex mMutex;
+    std::queue<T> mContainer;
+};
+
+// same shape as BufferEmitter::Data
+struct Chunk
+{
+    char* data;
+    size_t size;
+};
+
+template<typename Q>
+static void run(const char* name, int producers, size_t items, bool bulk)
+{
+    Q queue;
+    const size_t perProducer = items / producers;
+    const size_t total = perProducer * producers;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, perProducer]() {
+            for (size_t i = 0; i < perProducer; ++i) {
+                queue.push(Chunk { nullptr, i });
+            }
+        });
+    }
+
+    size_t received = 0;
+    std::vector<Chunk> chunks;
+    Chunk chunk;
+    while (received < total) {
+        if (bulk) {
+            chunks.clear();
+            received += queue.pop_all(chunks);
+        } else if (queue.pop(chunk)) {
+            ++received;
+        }
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("{\"bench\":\"queue\",\"queue\":\"%s\",\"producers\":%d,\"pop\":\"%s\",\"items\":%zu,\"seconds\":%.4f,\"mopsPerSec\":%.2f}\n",
+           name, producers, bulk ? "pop_all" : "pop", total, secs, total / secs / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t items = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+
+    for (int producers : { 1, 4 }) {
+        for (bool bulk : { false, true }) {
+            run<LockedQueue<Chunk> >("locked", producers, items, bulk);
+            run<Queue<Chunk> >("ring", producers, items, bulk);
+        }
+    }
+    return 0;
+}